@@ -0,0 +1,332 @@
+#include "http_stream.h"
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_http_client.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "jitter_buffer.h"
+
+#define STREAM_DATA_BIT (1 << 0)
+#define STREAM_SPACE_BIT (1 << 1)
+#define STREAM_EXITED_BIT (1 << 2)
+
+#define SPACE_POLL_TICKS pdMS_TO_TICKS(100)
+
+struct http_stream {
+    http_stream_config_t config;
+    jitter_buffer_t jb;
+    uint8_t *storage;
+    SemaphoreHandle_t lock;
+    EventGroupHandle_t events;
+    esp_http_client_handle_t client;
+    volatile bool stopping;
+    volatile bool seek_pending;
+    bool finished;
+    uint64_t seek_to;
+    uint64_t offset;
+    uint64_t skip;
+    int64_t content_length;
+    int64_t dropped_at_us;
+    uint32_t reconnects;
+    uint32_t last_recovery_ms;
+    uint32_t max_recovery_ms;
+};
+
+static const char *TAG = "HTTP_STREAM";
+
+static esp_err_t stream_open(struct http_stream *s) {
+    char range[32];
+    if (s->offset > 0) {
+        snprintf(range, sizeof(range), "bytes=%" PRIu64 "-", s->offset);
+        esp_http_client_set_header(s->client, "Range", range);
+    } else {
+        esp_http_client_delete_header(s->client, "Range");
+    }
+
+    esp_err_t err = esp_http_client_open(s->client, 0);
+    if (err != ESP_OK) {
+        return err;
+    }
+    int64_t length = esp_http_client_fetch_headers(s->client);
+    if (length < 0) {
+        esp_http_client_close(s->client);
+        return ESP_FAIL;
+    }
+
+    int status = esp_http_client_get_status_code(s->client);
+    if (status == 206) {
+        s->skip = 0;
+        if (length > 0) {
+            s->content_length = s->offset + length;
+        }
+    } else if (status == 200) {
+        /* Server ignored Range: throw away what we already have. */
+        s->skip = s->offset;
+        if (length > 0) {
+            s->content_length = length;
+        }
+    } else {
+        ESP_LOGE(TAG, "HTTP status %d", status);
+        esp_http_client_close(s->client);
+        return status >= 400 && status < 500 ? ESP_ERR_NOT_FOUND : ESP_FAIL;
+    }
+    if (s->offset > 0 && s->dropped_at_us != 0) {
+        s->reconnects++;
+        ESP_LOGI(TAG, "Resumed at byte %" PRIu64 " (status %d)", s->offset, status);
+    }
+    return ESP_OK;
+}
+
+static void note_first_byte(struct http_stream *s) {
+    if (s->dropped_at_us == 0) {
+        return;
+    }
+    uint32_t ms = (uint32_t)((esp_timer_get_time() - s->dropped_at_us) / 1000);
+    s->last_recovery_ms = ms;
+    if (ms > s->max_recovery_ms) {
+        s->max_recovery_ms = ms;
+    }
+    s->dropped_at_us = 0;
+}
+
+/*
+ * Reads until the resource ends (ESP_OK), the connection drops (ESP_FAIL) or
+ * a seek is requested (ESP_ERR_INVALID_STATE).
+ */
+static esp_err_t stream_pump(struct http_stream *s) {
+    while (!s->stopping && !s->seek_pending) {
+        uint8_t *span;
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        size_t n = jitter_buffer_write_span(&s->jb, &span);
+        xSemaphoreGive(s->lock);
+        if (n == 0) {
+            xEventGroupWaitBits(s->events, STREAM_SPACE_BIT, pdTRUE, pdFALSE, SPACE_POLL_TICKS);
+            continue;
+        }
+        if (n > s->config.read_chunk) {
+            n = s->config.read_chunk;
+        }
+        if (s->skip > 0 && n > s->skip) {
+            n = s->skip;
+        }
+
+        int got = esp_http_client_read(s->client, (char *)span, n);
+        if (got < 0) {
+            return ESP_FAIL;
+        }
+        if (got == 0) {
+            return esp_http_client_is_complete_data_received(s->client) ? ESP_OK : ESP_FAIL;
+        }
+        if (s->skip > 0) {
+            s->skip -= got;
+            continue;
+        }
+
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        /* The buffer was reset under the lock; whatever was read for the old position goes. */
+        if (s->seek_pending) {
+            xSemaphoreGive(s->lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+        jitter_buffer_commit(&s->jb, got);
+        xSemaphoreGive(s->lock);
+        xEventGroupSetBits(s->events, STREAM_DATA_BIT);
+
+        s->offset += got;
+        note_first_byte(s);
+        if (s->content_length > 0 && s->offset >= (uint64_t)s->content_length) {
+            return ESP_OK;
+        }
+    }
+    return s->seek_pending ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+static bool take_seek(struct http_stream *s) {
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    bool pending = s->seek_pending;
+    if (pending) {
+        s->seek_pending = false;
+        s->offset = s->seek_to;
+        s->skip = 0;
+    }
+    xSemaphoreGive(s->lock);
+    return pending;
+}
+
+static void mark_finished(struct http_stream *s) {
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    if (!s->seek_pending) {
+        jitter_buffer_set_eof(&s->jb);
+    }
+    xSemaphoreGive(s->lock);
+    xEventGroupSetBits(s->events, STREAM_DATA_BIT);
+    s->finished = true;
+}
+
+static void http_stream_task(void *pvParameters) {
+    struct http_stream *s = pvParameters;
+    uint32_t retry_ms = s->config.retry_min_ms;
+
+    while (!s->stopping) {
+        if (take_seek(s)) {
+            ESP_LOGI(TAG, "Seek to byte %" PRIu64, s->offset);
+            s->finished = false;
+            s->dropped_at_us = 0;
+            retry_ms = s->config.retry_min_ms;
+        }
+        /* Stay around after the end so the reader can still seek back. */
+        if (s->finished) {
+            xEventGroupWaitBits(s->events, STREAM_SPACE_BIT, pdTRUE, pdFALSE, SPACE_POLL_TICKS);
+            continue;
+        }
+
+        uint64_t before = s->offset;
+        esp_err_t err = stream_open(s);
+        if (err == ESP_ERR_NOT_FOUND) {
+            mark_finished(s);
+            continue;
+        }
+        if (err == ESP_OK) {
+            err = stream_pump(s);
+            esp_http_client_close(s->client);
+            if (err == ESP_OK) {
+                mark_finished(s);
+                continue;
+            }
+            if (err == ESP_ERR_INVALID_STATE) {
+                continue;
+            }
+        }
+        if (s->dropped_at_us == 0) {
+            s->dropped_at_us = esp_timer_get_time();
+            ESP_LOGW(TAG, "Connection dropped at byte %" PRIu64, s->offset);
+        }
+        retry_ms = s->offset > before ? s->config.retry_min_ms : retry_ms * 2;
+        if (retry_ms > s->config.retry_max_ms) {
+            retry_ms = s->config.retry_max_ms;
+        }
+        vTaskDelay(pdMS_TO_TICKS(retry_ms));
+    }
+
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    jitter_buffer_set_eof(&s->jb);
+    xSemaphoreGive(s->lock);
+    xEventGroupSetBits(s->events, STREAM_DATA_BIT | STREAM_EXITED_BIT);
+    vTaskDelete(NULL);
+}
+
+static void stream_free(struct http_stream *s) {
+    if (s->client) {
+        esp_http_client_cleanup(s->client);
+    }
+    if (s->events) {
+        vEventGroupDelete(s->events);
+    }
+    if (s->lock) {
+        vSemaphoreDelete(s->lock);
+    }
+    free(s->storage);
+    free(s);
+}
+
+esp_err_t http_stream_start(const http_stream_config_t *config, http_stream_handle_t *out) {
+    if (config->url == NULL || config->read_chunk == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    struct http_stream *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    s->config = *config;
+    s->content_length = -1;
+    s->storage = malloc(config->buffer_size);
+    s->lock = xSemaphoreCreateMutex();
+    s->events = xEventGroupCreate();
+    if (s->storage == NULL || s->lock == NULL || s->events == NULL) {
+        stream_free(s);
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = jitter_buffer_init(&s->jb, s->storage, config->buffer_size, config->low_watermark, config->high_watermark);
+    if (err != ESP_OK) {
+        stream_free(s);
+        return err;
+    }
+
+    esp_http_client_config_t http_config = {
+        .url = config->url,
+        .timeout_ms = config->timeout_ms,
+        .disable_auto_redirect = true,
+        .transport_type = HTTP_TRANSPORT_OVER_TCP,
+    };
+    s->client = esp_http_client_init(&http_config);
+    if (s->client == NULL) {
+        stream_free(s);
+        return ESP_FAIL;
+    }
+    if (xTaskCreate(&http_stream_task, "http_stream", config->task_stack, s, config->task_priority, NULL) != pdPASS) {
+        stream_free(s);
+        return ESP_ERR_NO_MEM;
+    }
+    *out = s;
+    return ESP_OK;
+}
+
+int http_stream_read(http_stream_handle_t s, void *dst, size_t len, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    while (true) {
+        xSemaphoreTake(s->lock, portMAX_DELAY);
+        size_t n = jitter_buffer_read(&s->jb, dst, len);
+        bool drained = jitter_buffer_drained(&s->jb);
+        xSemaphoreGive(s->lock);
+        if (n > 0) {
+            xEventGroupSetBits(s->events, STREAM_SPACE_BIT);
+            return (int)n;
+        }
+        if (drained) {
+            return -1;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            return 0;
+        }
+        xEventGroupWaitBits(s->events, STREAM_DATA_BIT, pdTRUE, pdFALSE, timeout - elapsed);
+    }
+}
+
+esp_err_t http_stream_seek(http_stream_handle_t s, uint64_t offset) {
+    if (s->content_length >= 0 && offset > (uint64_t)s->content_length) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    jitter_buffer_reset(&s->jb);
+    s->seek_to = offset;
+    s->seek_pending = true;
+    xSemaphoreGive(s->lock);
+    xEventGroupSetBits(s->events, STREAM_SPACE_BIT);
+    return ESP_OK;
+}
+
+void http_stream_get_stats(http_stream_handle_t s, http_stream_stats_t *stats) {
+    xSemaphoreTake(s->lock, portMAX_DELAY);
+    stats->fill = s->jb.fill;
+    stats->underruns = s->jb.underruns;
+    xSemaphoreGive(s->lock);
+    stats->bytes_received = s->offset;
+    stats->content_length = s->content_length;
+    stats->reconnects = s->reconnects;
+    stats->last_recovery_ms = s->last_recovery_ms;
+    stats->max_recovery_ms = s->max_recovery_ms;
+}
+
+void http_stream_stop(http_stream_handle_t s) {
+    s->stopping = true;
+    xEventGroupSetBits(s->events, STREAM_SPACE_BIT);
+    xEventGroupWaitBits(s->events, STREAM_EXITED_BIT, pdFALSE, pdFALSE, portMAX_DELAY);
+    stream_free(s);
+}
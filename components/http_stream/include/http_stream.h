@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    const char *url;
+    size_t buffer_size;
+    size_t low_watermark;
+    size_t high_watermark;
+    size_t read_chunk;
+    int timeout_ms;
+    uint32_t retry_min_ms;
+    uint32_t retry_max_ms;
+    UBaseType_t task_priority;
+    uint32_t task_stack;
+} http_stream_config_t;
+
+#define HTTP_STREAM_DEFAULT_CONFIG() {  \
+    .url = NULL,                        \
+    .buffer_size = 32 * 1024,           \
+    .low_watermark = 8 * 1024,          \
+    .high_watermark = 28 * 1024,        \
+    .read_chunk = 2048,                 \
+    .timeout_ms = 5000,                 \
+    .retry_min_ms = 250,                \
+    .retry_max_ms = 5000,               \
+    .task_priority = 6,                 \
+    .task_stack = 6144,                 \
+}
+
+typedef struct {
+    uint64_t bytes_received;        /* position in the resource, after any seek */
+    int64_t content_length;         /* -1 until known */
+    uint32_t fill;
+    uint32_t underruns;
+    uint32_t reconnects;
+    uint32_t last_recovery_ms;      /* from a dropped connection to the first byte after resuming */
+    uint32_t max_recovery_ms;
+} http_stream_stats_t;
+
+typedef struct http_stream *http_stream_handle_t;
+
+/* Allocates the jitter buffer once and starts the reader task. */
+esp_err_t http_stream_start(const http_stream_config_t *config, http_stream_handle_t *out);
+
+/*
+ * Blocks up to timeout for buffered data. Returns the number of bytes copied,
+ * 0 on timeout (including while rebuffering after an underrun) and -1 once
+ * the whole resource has been consumed.
+ */
+int http_stream_read(http_stream_handle_t stream, void *dst, size_t len, TickType_t timeout);
+
+/*
+ * Drops everything buffered and restarts the download at offset with a
+ * Range request. Reads block (rebuffering) until data from there arrives;
+ * the reader task stays alive after the end of the resource for this.
+ */
+esp_err_t http_stream_seek(http_stream_handle_t stream, uint64_t offset);
+
+void http_stream_get_stats(http_stream_handle_t stream, http_stream_stats_t *stats);
+
+/* Stops the reader task and frees everything. */
+void http_stream_stop(http_stream_handle_t stream);
+
+#ifdef __cplusplus
+}
+#endif
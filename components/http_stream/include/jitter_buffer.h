@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Byte ring between the network and the decoder. The producer stops reading
+ * once fill reaches high_watermark; the consumer gets nothing until fill
+ * reaches low_watermark, both at start and after every underrun.
+ * Not thread-safe: the caller serialises access.
+ */
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t head;
+    size_t tail;
+    size_t fill;
+    size_t low_watermark;
+    size_t high_watermark;
+    bool buffering;
+    bool eof;
+    uint32_t underruns;
+} jitter_buffer_t;
+
+esp_err_t jitter_buffer_init(jitter_buffer_t *jb, uint8_t *buf, size_t size, size_t low_watermark, size_t high_watermark);
+
+/* Drops buffered data and re-enters prebuffering; counters are kept. */
+void jitter_buffer_reset(jitter_buffer_t *jb);
+
+/* Contiguous free span at the write position, or 0 while at or above the high watermark. */
+size_t jitter_buffer_write_span(const jitter_buffer_t *jb, uint8_t **ptr);
+void jitter_buffer_commit(jitter_buffer_t *jb, size_t len);
+
+/* Marks the end of the stream so the tail drains without waiting for the low watermark. */
+void jitter_buffer_set_eof(jitter_buffer_t *jb);
+
+/* Copies out up to len bytes. Returns 0 while (re)buffering. */
+size_t jitter_buffer_read(jitter_buffer_t *jb, uint8_t *dst, size_t len);
+
+static inline bool jitter_buffer_drained(const jitter_buffer_t *jb) {
+    return jb->eof && jb->fill == 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,73 @@
+#include "jitter_buffer.h"
+
+#include <string.h>
+
+esp_err_t jitter_buffer_init(jitter_buffer_t *jb, uint8_t *buf, size_t size, size_t low_watermark, size_t high_watermark) {
+    if (buf == NULL || size == 0 || low_watermark == 0 || low_watermark > high_watermark || high_watermark > size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(jb, 0, sizeof(*jb));
+    jb->buf = buf;
+    jb->size = size;
+    jb->low_watermark = low_watermark;
+    jb->high_watermark = high_watermark;
+    jb->buffering = true;
+    return ESP_OK;
+}
+
+void jitter_buffer_reset(jitter_buffer_t *jb) {
+    jb->head = 0;
+    jb->tail = 0;
+    jb->fill = 0;
+    jb->buffering = true;
+    jb->eof = false;
+}
+
+size_t jitter_buffer_write_span(const jitter_buffer_t *jb, uint8_t **ptr) {
+    if (jb->fill >= jb->high_watermark) {
+        return 0;
+    }
+    size_t to_end = jb->size - jb->head;
+    size_t free = jb->size - jb->fill;
+    *ptr = &jb->buf[jb->head];
+    return free < to_end ? free : to_end;
+}
+
+void jitter_buffer_commit(jitter_buffer_t *jb, size_t len) {
+    jb->head += len;
+    if (jb->head == jb->size) {
+        jb->head = 0;
+    }
+    jb->fill += len;
+    if (jb->buffering && jb->fill >= jb->low_watermark) {
+        jb->buffering = false;
+    }
+}
+
+void jitter_buffer_set_eof(jitter_buffer_t *jb) {
+    jb->eof = true;
+    jb->buffering = false;
+}
+
+size_t jitter_buffer_read(jitter_buffer_t *jb, uint8_t *dst, size_t len) {
+    if (jb->buffering) {
+        return 0;
+    }
+    if (jb->fill == 0) {
+        if (!jb->eof) {
+            jb->underruns++;
+            jb->buffering = true;
+        }
+        return 0;
+    }
+    size_t n = len < jb->fill ? len : jb->fill;
+    size_t first = jb->size - jb->tail;
+    if (first > n) {
+        first = n;
+    }
+    memcpy(dst, &jb->buf[jb->tail], first);
+    memcpy(dst + first, jb->buf, n - first);
+    jb->tail = (jb->tail + n) % jb->size;
+    jb->fill -= n;
+    return n;
+}
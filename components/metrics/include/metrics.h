@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bucket i counts samples up to 2^(i + 4) us; the last one is unbounded. */
+#define METRICS_HISTOGRAM_BUCKETS 16
+#define METRICS_HISTOGRAM_MIN_SHIFT 4
+
+/*
+ * Metrics are registered once at start-up under a unique name and live
+ * forever; registering a name again returns the existing metric (a gauge
+ * keeps its first fn and ctx). Registration returns NULL when out of
+ * memory and recording to NULL does nothing. Counters may be bumped from
+ * any task. A histogram expects a single writer (its max is not updated
+ * atomically); scrapes may run concurrently with either.
+ */
+typedef struct metrics_counter {
+    const char *name;
+    atomic_uint_least32_t value;
+    struct metrics_counter *next;
+} metrics_counter_t;
+
+typedef struct metrics_histogram {
+    const char *name;
+    atomic_uint_least32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    atomic_uint_least32_t max_us;
+    atomic_uint_least64_t sum_us;
+    struct metrics_histogram *next;
+} metrics_histogram_t;
+
+/* Sampled at scrape time, for values a stage already keeps (buffer fill, stats structs). */
+typedef int64_t (*metrics_gauge_fn)(void *ctx);
+
+typedef enum {
+    METRICS_FORMAT_TEXT,    /* one "name value" line per sample, Prometheus exposition style */
+    METRICS_FORMAT_JSON,
+} metrics_format_t;
+
+typedef void (*metrics_write_fn)(void *ctx, const char *data, size_t len);
+
+#if CONFIG_METRICS_ENABLE
+
+metrics_counter_t *metrics_counter_register(const char *name);
+metrics_histogram_t *metrics_histogram_register(const char *name);
+esp_err_t metrics_gauge_register(const char *name, metrics_gauge_fn fn, void *ctx);
+
+static inline void metrics_counter_add(metrics_counter_t *counter, uint32_t n) {
+    if (counter == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&counter->value, n, memory_order_relaxed);
+}
+
+void metrics_histogram_record(metrics_histogram_t *hist, uint32_t us);
+
+/*
+ * Writes every metric, plus heap and per-task CPU share and stack
+ * high-water marks where the target supports them. CPU share covers the
+ * time since the previous render. Not reentrant.
+ */
+void metrics_render(metrics_format_t format, metrics_write_fn write, void *ctx);
+
+#else
+
+/* Recording compiles away; registration hands out NULL, which the stubs ignore. */
+static inline metrics_counter_t *metrics_counter_register(const char *name) { return NULL; }
+static inline metrics_histogram_t *metrics_histogram_register(const char *name) { return NULL; }
+static inline esp_err_t metrics_gauge_register(const char *name, metrics_gauge_fn fn, void *ctx) { return ESP_OK; }
+static inline void metrics_counter_add(metrics_counter_t *counter, uint32_t n) {}
+static inline void metrics_histogram_record(metrics_histogram_t *hist, uint32_t us) {}
+static inline void metrics_render(metrics_format_t format, metrics_write_fn write, void *ctx) {}
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
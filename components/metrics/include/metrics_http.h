@@ -0,0 +1,20 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define METRICS_HTTP_URI "/metrics"
+
+/*
+ * Serves GET /metrics on an existing server: text by default,
+ * JSON with ?format=json. ESP_ERR_NOT_SUPPORTED when metrics are compiled out.
+ */
+esp_err_t metrics_http_register(httpd_handle_t server);
+
+#ifdef __cplusplus
+}
+#endif
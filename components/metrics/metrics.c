@@ -0,0 +1,289 @@
+#include "metrics.h"
+
+#if CONFIG_METRICS_ENABLE
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#if !CONFIG_IDF_TARGET_LINUX
+#include "esp_heap_caps.h"
+#include "esp_system.h"
+#define METRICS_HAVE_HEAP 1
+#endif
+
+#if CONFIG_FREERTOS_USE_TRACE_FACILITY && CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS && !CONFIG_IDF_TARGET_LINUX
+#define METRICS_HAVE_TASKS 1
+#define METRICS_MAX_TASKS 24
+#endif
+
+#define METRICS_LINE_MAX 160
+
+typedef struct metrics_gauge {
+    const char *name;
+    metrics_gauge_fn fn;
+    void *ctx;
+    struct metrics_gauge *next;
+} metrics_gauge_t;
+
+typedef struct {
+    metrics_format_t format;
+    metrics_write_fn write;
+    void *ctx;
+    bool first;             /* no comma before the next JSON member */
+} renderer_t;
+
+/* Lists only ever grow at the head, so a scrape can walk them without a lock. */
+static _Atomic(metrics_counter_t *) counters;
+static _Atomic(metrics_histogram_t *) histograms;
+static _Atomic(metrics_gauge_t *) gauges;
+
+#define LIST_PUSH(head, item)                                                                   \
+    do {                                                                                        \
+        (item)->next = atomic_load(&(head));                                                    \
+        while (!atomic_compare_exchange_weak(&(head), &(item)->next, (item))) {                 \
+        }                                                                                       \
+    } while (0)
+
+metrics_counter_t *metrics_counter_register(const char *name) {
+    for (metrics_counter_t *c = atomic_load(&counters); c != NULL; c = c->next) {
+        if (strcmp(c->name, name) == 0) {
+            return c;
+        }
+    }
+    metrics_counter_t *counter = calloc(1, sizeof(*counter));
+    if (counter == NULL) {
+        return NULL;
+    }
+    counter->name = name;
+    LIST_PUSH(counters, counter);
+    return counter;
+}
+
+metrics_histogram_t *metrics_histogram_register(const char *name) {
+    for (metrics_histogram_t *h = atomic_load(&histograms); h != NULL; h = h->next) {
+        if (strcmp(h->name, name) == 0) {
+            return h;
+        }
+    }
+    metrics_histogram_t *hist = calloc(1, sizeof(*hist));
+    if (hist == NULL) {
+        return NULL;
+    }
+    hist->name = name;
+    LIST_PUSH(histograms, hist);
+    return hist;
+}
+
+esp_err_t metrics_gauge_register(const char *name, metrics_gauge_fn fn, void *ctx) {
+    for (metrics_gauge_t *g = atomic_load(&gauges); g != NULL; g = g->next) {
+        if (strcmp(g->name, name) == 0) {
+            return ESP_OK;
+        }
+    }
+    metrics_gauge_t *gauge = calloc(1, sizeof(*gauge));
+    if (gauge == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    gauge->name = name;
+    gauge->fn = fn;
+    gauge->ctx = ctx;
+    LIST_PUSH(gauges, gauge);
+    return ESP_OK;
+}
+
+void metrics_histogram_record(metrics_histogram_t *hist, uint32_t us) {
+    if (hist == NULL) {
+        return;
+    }
+    uint32_t i = us <= (1u << METRICS_HISTOGRAM_MIN_SHIFT) ? 0 : 32 - __builtin_clz(us - 1) - METRICS_HISTOGRAM_MIN_SHIFT;
+    if (i >= METRICS_HISTOGRAM_BUCKETS) {
+        i = METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&hist->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->sum_us, us, memory_order_relaxed);
+    if (us > atomic_load_explicit(&hist->max_us, memory_order_relaxed)) {
+        atomic_store_explicit(&hist->max_us, us, memory_order_relaxed);
+    }
+}
+
+static void emit(renderer_t *r, const char *fmt, ...) {
+    char line[METRICS_LINE_MAX];
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(line, sizeof(line), fmt, args);
+    va_end(args);
+    if (n > 0) {
+        r->write(r->ctx, line, (size_t)n < sizeof(line) ? (size_t)n : sizeof(line) - 1);
+    }
+}
+
+/* JSON only: opens a named member; bracket is '{' or '['. */
+static void json_open(renderer_t *r, const char *name, char bracket) {
+    emit(r, "%s\"%s\":%c", r->first ? "" : ",", name, bracket);
+    r->first = true;
+}
+
+static void json_close(renderer_t *r, char bracket) {
+    emit(r, "%c", bracket);
+    r->first = false;
+}
+
+static void sample(renderer_t *r, const char *name, const char *label, int64_t value) {
+    if (r->format == METRICS_FORMAT_TEXT) {
+        emit(r, "%s%s %" PRId64 "\n", name, label ? label : "", value);
+    } else {
+        emit(r, "%s\"%s\":%" PRId64, r->first ? "" : ",", name, value);
+        r->first = false;
+    }
+}
+
+static void render_histogram(renderer_t *r, metrics_histogram_t *hist) {
+    uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+    uint32_t count = 0;
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        buckets[i] = atomic_load_explicit(&hist->buckets[i], memory_order_relaxed);
+        count += buckets[i];
+    }
+    uint64_t sum = atomic_load_explicit(&hist->sum_us, memory_order_relaxed);
+    uint32_t max = atomic_load_explicit(&hist->max_us, memory_order_relaxed);
+
+    if (r->format == METRICS_FORMAT_TEXT) {
+        /* Cumulative buckets, as Prometheus expects. */
+        uint32_t total = 0;
+        for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+            total += buckets[i];
+            if (i < METRICS_HISTOGRAM_BUCKETS - 1) {
+                emit(r, "%s_bucket{le=\"%lu\"} %lu\n", hist->name,
+                     (unsigned long)1 << (i + METRICS_HISTOGRAM_MIN_SHIFT), (unsigned long)total);
+            } else {
+                emit(r, "%s_bucket{le=\"+Inf\"} %lu\n", hist->name, (unsigned long)total);
+            }
+        }
+        emit(r, "%s_sum %" PRIu64 "\n%s_count %lu\n%s_max %lu\n", hist->name, sum, hist->name,
+             (unsigned long)count, hist->name, (unsigned long)max);
+        return;
+    }
+    json_open(r, hist->name, '{');
+    sample(r, "count", NULL, count);
+    sample(r, "sum_us", NULL, (int64_t)sum);
+    sample(r, "max_us", NULL, max);
+    /* Per-bucket counts, not cumulative. */
+    emit(r, ",\"buckets\":[");
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        emit(r, i ? ",%lu" : "%lu", (unsigned long)buckets[i]);
+    }
+    emit(r, "]");
+    json_close(r, '}');
+}
+
+#if METRICS_HAVE_TASKS
+typedef struct {
+    TaskHandle_t handle;
+    configRUN_TIME_COUNTER_TYPE runtime;
+} task_runtime_t;
+
+static TaskStatus_t task_status[METRICS_MAX_TASKS];
+static task_runtime_t prev_runtime[METRICS_MAX_TASKS];
+static UBaseType_t prev_count;
+static configRUN_TIME_COUNTER_TYPE prev_total;
+
+static configRUN_TIME_COUNTER_TYPE previous_runtime(TaskHandle_t handle) {
+    for (UBaseType_t i = 0; i < prev_count; i++) {
+        if (prev_runtime[i].handle == handle) {
+            return prev_runtime[i].runtime;
+        }
+    }
+    return 0;
+}
+
+static void render_tasks(renderer_t *r) {
+    configRUN_TIME_COUNTER_TYPE total;
+    UBaseType_t n = uxTaskGetSystemState(task_status, METRICS_MAX_TASKS, &total);
+    /* Each core accrues its own run time, so shares are of all cores together. */
+    uint64_t elapsed = (uint64_t)(configRUN_TIME_COUNTER_TYPE)(total - prev_total) * portNUM_PROCESSORS;
+    task_runtime_t now[METRICS_MAX_TASKS];
+    char label[48];
+
+    if (r->format == METRICS_FORMAT_JSON) {
+        json_open(r, "tasks", '{');
+    }
+    for (UBaseType_t i = 0; i < n; i++) {
+        const TaskStatus_t *t = &task_status[i];
+        configRUN_TIME_COUNTER_TYPE ran = t->ulRunTimeCounter - previous_runtime(t->xHandle);
+        int64_t percent = elapsed ? (int64_t)((uint64_t)ran * 100 / elapsed) : 0;
+        int64_t stack_free = (int64_t)t->usStackHighWaterMark * sizeof(StackType_t);
+        if (r->format == METRICS_FORMAT_TEXT) {
+            snprintf(label, sizeof(label), "{task=\"%s\"}", t->pcTaskName);
+            sample(r, "task_cpu_percent", label, percent);
+            sample(r, "task_stack_free_bytes", label, stack_free);
+        } else {
+            json_open(r, t->pcTaskName, '{');
+            sample(r, "cpu_percent", NULL, percent);
+            sample(r, "stack_free_bytes", NULL, stack_free);
+            json_close(r, '}');
+        }
+        now[i].handle = t->xHandle;
+        now[i].runtime = t->ulRunTimeCounter;
+    }
+    if (r->format == METRICS_FORMAT_JSON) {
+        json_close(r, '}');
+    }
+    memcpy(prev_runtime, now, n * sizeof(now[0]));
+    prev_count = n;
+    prev_total = total;
+}
+#endif
+
+void metrics_render(metrics_format_t format, metrics_write_fn write, void *ctx) {
+    renderer_t r = { .format = format, .write = write, .ctx = ctx, .first = true };
+    bool json = format == METRICS_FORMAT_JSON;
+
+    if (json) {
+        emit(&r, "{");
+    }
+    sample(&r, "uptime_us", NULL, esp_timer_get_time());
+#if METRICS_HAVE_HEAP
+    sample(&r, "heap_free_bytes", NULL, esp_get_free_heap_size());
+    sample(&r, "heap_min_free_bytes", NULL, esp_get_minimum_free_heap_size());
+    sample(&r, "heap_largest_block_bytes", NULL, heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+#endif
+
+    if (json) {
+        json_open(&r, "counters", '{');
+    }
+    for (metrics_counter_t *c = atomic_load(&counters); c != NULL; c = c->next) {
+        sample(&r, c->name, NULL, atomic_load_explicit(&c->value, memory_order_relaxed));
+    }
+    if (json) {
+        json_close(&r, '}');
+        json_open(&r, "gauges", '{');
+    }
+    for (metrics_gauge_t *g = atomic_load(&gauges); g != NULL; g = g->next) {
+        sample(&r, g->name, NULL, g->fn(g->ctx));
+    }
+    if (json) {
+        json_close(&r, '}');
+        json_open(&r, "histograms", '{');
+    }
+    for (metrics_histogram_t *h = atomic_load(&histograms); h != NULL; h = h->next) {
+        render_histogram(&r, h);
+    }
+    if (json) {
+        json_close(&r, '}');
+    }
+#if METRICS_HAVE_TASKS
+    render_tasks(&r);
+#endif
+    if (json) {
+        emit(&r, "}\n");
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+#include "metrics_http.h"
+
+#include <string.h>
+#include "metrics.h"
+
+#if CONFIG_METRICS_ENABLE
+
+#define METRICS_HTTP_CHUNK 512
+
+typedef struct {
+    httpd_req_t *req;
+    esp_err_t err;
+    size_t len;
+    char buf[METRICS_HTTP_CHUNK];
+} chunk_writer_t;
+
+static void flush(chunk_writer_t *w) {
+    if (w->len > 0 && w->err == ESP_OK) {
+        w->err = httpd_resp_send_chunk(w->req, w->buf, w->len);
+    }
+    w->len = 0;
+}
+
+/* Lines are batched into chunks; one send per line would cost a TCP segment each. */
+static void write_chunked(void *ctx, const char *data, size_t len) {
+    chunk_writer_t *w = ctx;
+    if (w->len + len > sizeof(w->buf)) {
+        flush(w);
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static esp_err_t metrics_get_handler(httpd_req_t *req) {
+    metrics_format_t format = METRICS_FORMAT_TEXT;
+    char query[32];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+        httpd_query_key_value(query, "format", value, sizeof(value)) == ESP_OK && strcmp(value, "json") == 0) {
+        format = METRICS_FORMAT_JSON;
+    }
+    httpd_resp_set_type(req, format == METRICS_FORMAT_JSON ? "application/json" : "text/plain; version=0.0.4");
+
+    static chunk_writer_t writer;
+    writer.req = req;
+    writer.err = ESP_OK;
+    writer.len = 0;
+    metrics_render(format, write_chunked, &writer);
+    flush(&writer);
+    if (writer.err != ESP_OK) {
+        return writer.err;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+esp_err_t metrics_http_register(httpd_handle_t server) {
+    static const httpd_uri_t uri = {
+        .uri = METRICS_HTTP_URI,
+        .method = HTTP_GET,
+        .handler = metrics_get_handler,
+    };
+    return httpd_register_uri_handler(server, &uri);
+}
+
+#else
+
+esp_err_t metrics_http_register(httpd_handle_t server) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif
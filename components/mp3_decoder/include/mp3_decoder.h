@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "mp3_frame.h"
+#include "mp3_index.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Output is always interleaved stereo; one call produces at most this many frames. */
+#define MP3_DECODER_MAX_FRAMES 1152
+#define MP3_DECODER_CHANNELS 2
+
+/*
+ * Frames decoded and thrown away after a seek so the bit reservoir, IMDCT
+ * overlap and synthesis history are rebuilt before audio is produced.
+ */
+#define MP3_DECODER_PRIME_FRAMES 4
+
+typedef struct {
+    /* Blocks for data; returns bytes read, 0 at end of stream, negative on error. */
+    int (*read)(void *ctx, void *buf, size_t len);
+    /* Optional: repositions the source so the next read starts at offset. */
+    esp_err_t (*seek)(void *ctx, uint32_t offset);
+    void *ctx;
+} mp3_source_t;
+
+typedef struct {
+    uint32_t sample_rate;
+    uint16_t frames;            /* stereo PCM frames written */
+    uint16_t bitrate_kbps;
+    uint8_t channels;           /* in the bitstream; mono is duplicated to both outputs */
+} mp3_frame_info_t;
+
+typedef struct {
+    uint32_t frames_decoded;
+    uint32_t frames_skipped;
+    uint32_t decode_errors;
+    uint32_t resyncs;
+    uint32_t max_decode_us;
+} mp3_decoder_stats_t;
+
+typedef struct mp3_decoder mp3_decoder_t;
+
+/* The only allocations: the decoder state and its input buffer, once, up front. */
+esp_err_t mp3_decoder_create(mp3_decoder_t **out);
+void mp3_decoder_destroy(mp3_decoder_t *dec);
+
+/*
+ * Starts a new stream at its first byte. A leading ID3v2 tag is skipped.
+ * Frames are recorded in `index` (may be NULL) as they go past.
+ */
+void mp3_decoder_open(mp3_decoder_t *dec, const mp3_source_t *source, mp3_index_t *index);
+
+/*
+ * Decodes the next frame straight into pcm, which must hold
+ * MP3_DECODER_MAX_FRAMES stereo frames (e.g. a reserved PCM ring slot).
+ * A corrupt frame yields silence so the timeline stays intact.
+ * Returns ESP_ERR_NOT_FOUND at end of stream.
+ */
+esp_err_t mp3_decoder_decode(mp3_decoder_t *dec, int16_t *pcm, mp3_frame_info_t *info);
+
+/*
+ * Positions the decoder so the next decode returns frame `frame`. Uses the
+ * index to reposition the source when it can seek, otherwise walks headers
+ * forward; either way frames walked over extend the index.
+ */
+esp_err_t mp3_decoder_seek(mp3_decoder_t *dec, uint32_t frame);
+
+/* Number of the frame the next decode returns. */
+uint32_t mp3_decoder_tell(const mp3_decoder_t *dec);
+
+void mp3_decoder_get_stats(const mp3_decoder_t *dec, mp3_decoder_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
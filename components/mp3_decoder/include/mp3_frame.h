@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MP3_FRAME_HEADER_BYTES 4
+/* 320 kbit/s at 32 kHz plus padding: the largest Layer III frame. */
+#define MP3_FRAME_MAX_BYTES 1441
+
+typedef enum {
+    MP3_VERSION_1,
+    MP3_VERSION_2,
+    MP3_VERSION_25,
+} mp3_version_t;
+
+typedef struct {
+    mp3_version_t version;
+    uint8_t channels;
+    uint8_t side_info_bytes;
+    uint16_t samples;
+    uint16_t bitrate_kbps;
+    uint16_t frame_bytes;
+    uint32_t sample_rate;
+} mp3_frame_header_t;
+
+/* Decodes a Layer III frame header. Free-format and reserved values are rejected. */
+bool mp3_frame_parse(const uint8_t *header, mp3_frame_header_t *out);
+
+/* True when both headers could belong to the same stream; used to reject false syncs. */
+bool mp3_frame_compatible(const mp3_frame_header_t *a, const mp3_frame_header_t *b);
+
+/* Total size of a leading ID3v2 tag (header, body and footer), or 0 if buf does not start with one. */
+size_t mp3_id3v2_size(const uint8_t *buf, size_t len);
+
+/* Frame count from a Xing/Info or VBRI header in the first frame, if present. */
+bool mp3_vbr_frame_count(const uint8_t *frame, size_t len, const mp3_frame_header_t *header, uint32_t *frames);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "mp3_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* One anchor every 16 frames: ~0.4 s of audio, 4 bytes per anchor. */
+#define MP3_INDEX_STRIDE 16
+#define MP3_INDEX_CACHE_SLOTS 4
+
+/*
+ * Byte offsets of every MP3_INDEX_STRIDE-th frame. Built lazily as frames go
+ * past the decoder (or by an explicit header scan), so a seek costs one
+ * lookup plus at most MP3_INDEX_STRIDE - 1 header hops.
+ */
+typedef struct {
+    uint32_t *anchors;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t frames;            /* frames indexed so far */
+    uint32_t next_offset;       /* where frame `frames` starts */
+    uint32_t sample_rate;
+    uint16_t samples_per_frame;
+    bool complete;
+} mp3_index_t;
+
+/* Reads len bytes at offset; returns the count read, short at end of file. */
+typedef int (*mp3_read_at_fn)(void *ctx, uint32_t offset, void *buf, size_t len);
+
+void mp3_index_init(mp3_index_t *index, uint32_t first_frame_offset);
+void mp3_index_free(mp3_index_t *index);
+
+/* Records frame number `frame`; frames must arrive in order and anything else is ignored. */
+esp_err_t mp3_index_add(mp3_index_t *index, uint32_t frame, uint32_t offset, const mp3_frame_header_t *header);
+void mp3_index_finish(mp3_index_t *index, uint32_t frames);
+
+/* Header-only walk from the last indexed frame until `until_frame` is indexed or the audio ends. */
+esp_err_t mp3_index_scan(mp3_index_t *index, mp3_read_at_fn read_at, void *ctx, uint32_t until_frame);
+
+/*
+ * Nearest indexed frame at or before `frame`. When `frame` lies past the
+ * indexed range the last anchor is returned and the caller walks forward.
+ */
+esp_err_t mp3_index_locate(const mp3_index_t *index, uint32_t frame, uint32_t *anchor_frame, uint32_t *anchor_offset);
+
+uint32_t mp3_index_frame_at_ms(const mp3_index_t *index, uint32_t ms);
+uint32_t mp3_index_duration_ms(const mp3_index_t *index);
+
+esp_err_t mp3_index_save(const mp3_index_t *index, FILE *f);
+esp_err_t mp3_index_load(mp3_index_t *index, FILE *f);
+
+/*
+ * Small LRU of indexes keyed by path or URL so going back to a recent track
+ * seeks without rebuilding. Not thread-safe: owned by the player task.
+ */
+mp3_index_t *mp3_index_cache_get(const char *key, bool *hit);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,225 @@
+#include "mp3_decoder.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "mp3dec.h"
+
+/* Room for a frame plus the next header, so a resync can confirm a second sync word. */
+#define LOOKAHEAD_BYTES (2 * MP3_FRAME_MAX_BYTES + MP3_FRAME_HEADER_BYTES)
+#define INBUF_BYTES 4096
+
+struct mp3_decoder {
+    HMP3Decoder helix;
+    mp3_source_t source;
+    mp3_index_t *index;
+    uint32_t frame;             /* number of the frame at inbuf[pos] */
+    uint32_t offset;            /* source offset of inbuf[0] */
+    size_t pos;
+    size_t len;
+    size_t discard;
+    uint32_t prime;
+    bool check_id3;
+    bool eof;
+    mp3_decoder_stats_t stats;
+    uint8_t inbuf[INBUF_BYTES];
+};
+
+esp_err_t mp3_decoder_create(mp3_decoder_t **out) {
+    mp3_decoder_t *dec = calloc(1, sizeof(*dec));
+    if (dec == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    dec->helix = MP3InitDecoder();
+    if (dec->helix == NULL) {
+        free(dec);
+        return ESP_ERR_NO_MEM;
+    }
+    *out = dec;
+    return ESP_OK;
+}
+
+void mp3_decoder_destroy(mp3_decoder_t *dec) {
+    MP3FreeDecoder(dec->helix);
+    free(dec);
+}
+
+static void reset_input(mp3_decoder_t *dec, uint32_t offset, uint32_t frame) {
+    dec->offset = offset;
+    dec->frame = frame;
+    dec->pos = 0;
+    dec->len = 0;
+    dec->discard = 0;
+    dec->prime = 0;
+    dec->eof = false;
+    dec->check_id3 = offset == 0;
+}
+
+void mp3_decoder_open(mp3_decoder_t *dec, const mp3_source_t *source, mp3_index_t *index) {
+    dec->source = *source;
+    dec->index = index;
+    memset(&dec->stats, 0, sizeof(dec->stats));
+    reset_input(dec, 0, 0);
+}
+
+static void refill(mp3_decoder_t *dec) {
+    if (dec->pos > 0) {
+        memmove(dec->inbuf, dec->inbuf + dec->pos, dec->len - dec->pos);
+        dec->offset += dec->pos;
+        dec->len -= dec->pos;
+        dec->pos = 0;
+    }
+    while (!dec->eof && dec->len < sizeof(dec->inbuf)) {
+        int n = dec->source.read(dec->source.ctx, dec->inbuf + dec->len, sizeof(dec->inbuf) - dec->len);
+        if (n <= 0) {
+            dec->eof = true;
+            break;
+        }
+        dec->len += n;
+    }
+}
+
+/* Leaves inbuf[pos] at a complete frame; false at end of stream. */
+static bool next_frame(mp3_decoder_t *dec, mp3_frame_header_t *header) {
+    bool synced = true;
+    while (true) {
+        if (dec->len - dec->pos < LOOKAHEAD_BYTES) {
+            refill(dec);
+        }
+        size_t avail = dec->len - dec->pos;
+        const uint8_t *p = dec->inbuf + dec->pos;
+        if (dec->discard > 0) {
+            if (avail == 0) {
+                return false;
+            }
+            size_t n = dec->discard < avail ? dec->discard : avail;
+            dec->pos += n;
+            dec->discard -= n;
+            continue;
+        }
+        if (dec->check_id3) {
+            dec->check_id3 = false;
+            dec->discard = mp3_id3v2_size(p, avail);
+            continue;
+        }
+        if (avail < MP3_FRAME_HEADER_BYTES) {
+            return false;
+        }
+        if (mp3_frame_parse(p, header) && header->frame_bytes <= avail) {
+            mp3_frame_header_t next;
+            /* After losing sync, insist on a second matching header before trusting the first. */
+            if (synced || avail < (size_t)header->frame_bytes + MP3_FRAME_HEADER_BYTES ||
+                (mp3_frame_parse(p + header->frame_bytes, &next) && mp3_frame_compatible(header, &next))) {
+                return true;
+            }
+        }
+        if (synced) {
+            synced = false;
+            dec->stats.resyncs++;
+        }
+        dec->pos++;
+    }
+}
+
+static void consume_frame(mp3_decoder_t *dec, const mp3_frame_header_t *header) {
+    if (dec->index) {
+        mp3_index_add(dec->index, dec->frame, dec->offset + dec->pos, header);
+    }
+    dec->pos += header->frame_bytes;
+    dec->frame++;
+}
+
+static void end_of_stream(mp3_decoder_t *dec) {
+    if (dec->index) {
+        mp3_index_finish(dec->index, dec->frame);
+    }
+}
+
+esp_err_t mp3_decoder_decode(mp3_decoder_t *dec, int16_t *pcm, mp3_frame_info_t *info) {
+    mp3_frame_header_t header;
+    while (next_frame(dec, &header)) {
+        int64_t start = esp_timer_get_time();
+        unsigned char *p = dec->inbuf + dec->pos;
+        int left = header.frame_bytes;
+        int err = MP3Decode(dec->helix, &p, &left, pcm, 0);
+        consume_frame(dec, &header);
+        if (dec->prime > 0) {
+            dec->prime--;
+            continue;
+        }
+
+        size_t samples = header.samples;
+        if (err == ERR_MP3_NONE) {
+            if (header.channels == 1) {
+                /* Widen in place from the back so no sample is overwritten before it is read. */
+                for (size_t i = samples; i-- > 0;) {
+                    pcm[2 * i + 1] = pcm[i];
+                    pcm[2 * i] = pcm[i];
+                }
+            }
+            dec->stats.frames_decoded++;
+        } else {
+            /* Includes a missing bit reservoir at the start of a cut stream. */
+            memset(pcm, 0, samples * MP3_DECODER_CHANNELS * sizeof(int16_t));
+            dec->stats.decode_errors++;
+        }
+
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+        if (elapsed > dec->stats.max_decode_us) {
+            dec->stats.max_decode_us = elapsed;
+        }
+        info->sample_rate = header.sample_rate;
+        info->frames = samples;
+        info->bitrate_kbps = header.bitrate_kbps;
+        info->channels = header.channels;
+        return ESP_OK;
+    }
+    end_of_stream(dec);
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t mp3_decoder_seek(mp3_decoder_t *dec, uint32_t frame) {
+    uint32_t target = frame > MP3_DECODER_PRIME_FRAMES ? frame - MP3_DECODER_PRIME_FRAMES : 0;
+    uint32_t anchor_frame, anchor_offset;
+    bool have_anchor = dec->source.seek && dec->index &&
+                       mp3_index_locate(dec->index, target, &anchor_frame, &anchor_offset) == ESP_OK;
+
+    /* Walking forward from where we are beats a reposition unless an anchor is closer. */
+    if (have_anchor && (target < dec->frame || anchor_frame > dec->frame)) {
+        esp_err_t err = dec->source.seek(dec->source.ctx, anchor_offset);
+        if (err != ESP_OK) {
+            return err;
+        }
+        reset_input(dec, anchor_offset, anchor_frame);
+        dec->check_id3 = false;
+    } else if (target < dec->frame) {
+        if (dec->source.seek == NULL) {
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+        esp_err_t err = dec->source.seek(dec->source.ctx, 0);
+        if (err != ESP_OK) {
+            return err;
+        }
+        reset_input(dec, 0, 0);
+    }
+
+    mp3_frame_header_t header;
+    while (dec->frame < target) {
+        if (!next_frame(dec, &header)) {
+            end_of_stream(dec);
+            return ESP_ERR_NOT_FOUND;
+        }
+        consume_frame(dec, &header);
+        dec->stats.frames_skipped++;
+    }
+    dec->prime = frame - dec->frame;
+    return ESP_OK;
+}
+
+uint32_t mp3_decoder_tell(const mp3_decoder_t *dec) {
+    return dec->frame + dec->prime;
+}
+
+void mp3_decoder_get_stats(const mp3_decoder_t *dec, mp3_decoder_stats_t *stats) {
+    *stats = dec->stats;
+}
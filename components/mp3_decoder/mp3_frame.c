@@ -0,0 +1,89 @@
+#include "mp3_frame.h"
+
+#include <string.h>
+
+static const uint16_t bitrates_v1[15] = {
+    0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320,
+};
+
+static const uint16_t bitrates_v2[15] = {
+    0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160,
+};
+
+static const uint32_t sample_rates[3][3] = {
+    [MP3_VERSION_1] = { 44100, 48000, 32000 },
+    [MP3_VERSION_2] = { 22050, 24000, 16000 },
+    [MP3_VERSION_25] = { 11025, 12000, 8000 },
+};
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+bool mp3_frame_parse(const uint8_t *h, mp3_frame_header_t *out) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    uint8_t version_bits = (h[1] >> 3) & 0x03;
+    uint8_t layer_bits = (h[1] >> 1) & 0x03;
+    uint8_t bitrate_index = h[2] >> 4;
+    uint8_t rate_index = (h[2] >> 2) & 0x03;
+    if (version_bits == 1 || layer_bits != 1 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) {
+        return false;
+    }
+
+    mp3_version_t version = version_bits == 3 ? MP3_VERSION_1 : version_bits == 2 ? MP3_VERSION_2 : MP3_VERSION_25;
+    bool mono = (h[3] >> 6) == 3;
+    uint32_t padding = (h[2] >> 1) & 0x01;
+
+    out->version = version;
+    out->channels = mono ? 1 : 2;
+    out->sample_rate = sample_rates[version][rate_index];
+    if (version == MP3_VERSION_1) {
+        out->bitrate_kbps = bitrates_v1[bitrate_index];
+        out->samples = 1152;
+        out->side_info_bytes = mono ? 17 : 32;
+        out->frame_bytes = 144000 * out->bitrate_kbps / out->sample_rate + padding;
+    } else {
+        out->bitrate_kbps = bitrates_v2[bitrate_index];
+        out->samples = 576;
+        out->side_info_bytes = mono ? 9 : 17;
+        out->frame_bytes = 72000 * out->bitrate_kbps / out->sample_rate + padding;
+    }
+    return true;
+}
+
+bool mp3_frame_compatible(const mp3_frame_header_t *a, const mp3_frame_header_t *b) {
+    return a->version == b->version && a->sample_rate == b->sample_rate && a->channels == b->channels;
+}
+
+size_t mp3_id3v2_size(const uint8_t *buf, size_t len) {
+    if (len < 10 || memcmp(buf, "ID3", 3) != 0) {
+        return 0;
+    }
+    /* Sizes are syncsafe: 7 bits per byte. */
+    if ((buf[6] | buf[7] | buf[8] | buf[9]) & 0x80) {
+        return 0;
+    }
+    size_t size = ((size_t)buf[6] << 21) | ((size_t)buf[7] << 14) | ((size_t)buf[8] << 7) | buf[9];
+    bool footer = buf[3] == 4 && (buf[5] & 0x10);
+    return 10 + size + (footer ? 10 : 0);
+}
+
+bool mp3_vbr_frame_count(const uint8_t *frame, size_t len, const mp3_frame_header_t *header, uint32_t *frames) {
+    size_t xing = MP3_FRAME_HEADER_BYTES + header->side_info_bytes;
+    if (len >= xing + 12 && (memcmp(frame + xing, "Xing", 4) == 0 || memcmp(frame + xing, "Info", 4) == 0)) {
+        uint32_t flags = read_be32(frame + xing + 4);
+        if (flags & 0x01) {
+            *frames = read_be32(frame + xing + 8);
+            return true;
+        }
+        return false;
+    }
+    const size_t vbri = MP3_FRAME_HEADER_BYTES + 32;
+    if (len >= vbri + 18 && memcmp(frame + vbri, "VBRI", 4) == 0) {
+        *frames = read_be32(frame + vbri + 14);
+        return true;
+    }
+    return false;
+}
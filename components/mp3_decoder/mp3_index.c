@@ -0,0 +1,211 @@
+#include "mp3_index.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define INDEX_MAGIC 0x4933504Du /* "MP3I" */
+#define INDEX_VERSION 1
+#define INDEX_MIN_CAPACITY 64
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t frames;
+    uint32_t next_offset;
+    uint32_t sample_rate;
+    uint32_t samples_per_frame;
+    uint32_t complete;
+} index_file_header_t;
+
+typedef struct {
+    uint32_t key_hash;          /* checked first; the key decides */
+    char *key;
+    uint32_t last_used;
+    bool used;
+    mp3_index_t index;
+} cache_slot_t;
+
+static cache_slot_t cache[MP3_INDEX_CACHE_SLOTS];
+static uint32_t cache_clock;
+
+void mp3_index_init(mp3_index_t *index, uint32_t first_frame_offset) {
+    memset(index, 0, sizeof(*index));
+    index->next_offset = first_frame_offset;
+}
+
+void mp3_index_free(mp3_index_t *index) {
+    free(index->anchors);
+    mp3_index_init(index, 0);
+}
+
+static esp_err_t reserve(mp3_index_t *index, uint32_t count) {
+    if (count <= index->capacity) {
+        return ESP_OK;
+    }
+    uint32_t capacity = index->capacity ? index->capacity : INDEX_MIN_CAPACITY;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+    uint32_t *anchors = realloc(index->anchors, capacity * sizeof(uint32_t));
+    if (anchors == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    index->anchors = anchors;
+    index->capacity = capacity;
+    return ESP_OK;
+}
+
+esp_err_t mp3_index_add(mp3_index_t *index, uint32_t frame, uint32_t offset, const mp3_frame_header_t *header) {
+    if (index->complete || frame != index->frames) {
+        return ESP_OK;
+    }
+    if (frame == 0) {
+        index->sample_rate = header->sample_rate;
+        index->samples_per_frame = header->samples;
+    }
+    if (frame % MP3_INDEX_STRIDE == 0) {
+        esp_err_t err = reserve(index, index->count + 1);
+        if (err != ESP_OK) {
+            return err;
+        }
+        index->anchors[index->count++] = offset;
+    }
+    index->frames++;
+    index->next_offset = offset + header->frame_bytes;
+    return ESP_OK;
+}
+
+void mp3_index_finish(mp3_index_t *index, uint32_t frames) {
+    if (frames == index->frames) {
+        index->complete = true;
+    }
+}
+
+esp_err_t mp3_index_scan(mp3_index_t *index, mp3_read_at_fn read_at, void *ctx, uint32_t until_frame) {
+    if (index->frames == 0) {
+        uint8_t tag[10];
+        if (read_at(ctx, index->next_offset, tag, sizeof(tag)) == sizeof(tag)) {
+            index->next_offset += mp3_id3v2_size(tag, sizeof(tag));
+        }
+    }
+    while (!index->complete && index->frames <= until_frame) {
+        uint8_t raw[MP3_FRAME_HEADER_BYTES];
+        mp3_frame_header_t header;
+        /* A short read, a trailing tag or junk all end the audio. */
+        if (read_at(ctx, index->next_offset, raw, sizeof(raw)) != sizeof(raw) || !mp3_frame_parse(raw, &header)) {
+            index->complete = true;
+            break;
+        }
+        esp_err_t err = mp3_index_add(index, index->frames, index->next_offset, &header);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t mp3_index_locate(const mp3_index_t *index, uint32_t frame, uint32_t *anchor_frame, uint32_t *anchor_offset) {
+    if (index->count == 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    uint32_t slot = frame / MP3_INDEX_STRIDE;
+    if (slot >= index->count) {
+        slot = index->count - 1;
+    }
+    *anchor_frame = slot * MP3_INDEX_STRIDE;
+    *anchor_offset = index->anchors[slot];
+    return ESP_OK;
+}
+
+uint32_t mp3_index_frame_at_ms(const mp3_index_t *index, uint32_t ms) {
+    if (index->samples_per_frame == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)ms * index->sample_rate / (1000ull * index->samples_per_frame));
+}
+
+uint32_t mp3_index_duration_ms(const mp3_index_t *index) {
+    if (index->sample_rate == 0) {
+        return 0;
+    }
+    return (uint32_t)((uint64_t)index->frames * index->samples_per_frame * 1000 / index->sample_rate);
+}
+
+esp_err_t mp3_index_save(const mp3_index_t *index, FILE *f) {
+    index_file_header_t header = {
+        .magic = INDEX_MAGIC,
+        .version = INDEX_VERSION,
+        .count = index->count,
+        .frames = index->frames,
+        .next_offset = index->next_offset,
+        .sample_rate = index->sample_rate,
+        .samples_per_frame = index->samples_per_frame,
+        .complete = index->complete,
+    };
+    if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+        fwrite(index->anchors, sizeof(uint32_t), index->count, f) != index->count) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t mp3_index_load(mp3_index_t *index, FILE *f) {
+    index_file_header_t header;
+    if (fread(&header, sizeof(header), 1, f) != 1) {
+        return ESP_FAIL;
+    }
+    if (header.magic != INDEX_MAGIC || header.version != INDEX_VERSION ||
+        header.count != (header.frames + MP3_INDEX_STRIDE - 1) / MP3_INDEX_STRIDE) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    mp3_index_free(index);
+    esp_err_t err = reserve(index, header.count);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (fread(index->anchors, sizeof(uint32_t), header.count, f) != header.count) {
+        mp3_index_free(index);
+        return ESP_FAIL;
+    }
+    index->count = header.count;
+    index->frames = header.frames;
+    index->next_offset = header.next_offset;
+    index->sample_rate = header.sample_rate;
+    index->samples_per_frame = header.samples_per_frame;
+    index->complete = header.complete != 0;
+    return ESP_OK;
+}
+
+static uint32_t hash_key(const char *key) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    while (*key) {
+        h = (h ^ (uint8_t)*key++) * 16777619u;
+    }
+    return h;
+}
+
+mp3_index_t *mp3_index_cache_get(const char *key, bool *hit) {
+    uint32_t h = hash_key(key);
+    cache_slot_t *victim = &cache[0];
+    for (int i = 0; i < MP3_INDEX_CACHE_SLOTS; i++) {
+        cache_slot_t *slot = &cache[i];
+        if (slot->used && slot->key_hash == h && slot->key != NULL && strcmp(slot->key, key) == 0) {
+            slot->last_used = ++cache_clock;
+            *hit = true;
+            return &slot->index;
+        }
+        if (!slot->used || (victim->used && slot->last_used < victim->last_used)) {
+            victim = slot;
+        }
+    }
+    mp3_index_free(&victim->index);
+    free(victim->key);
+    victim->used = true;
+    victim->key_hash = h;
+    victim->key = strdup(key);     /* NULL on failure: the slot just never hits */
+    victim->last_used = ++cache_clock;
+    *hit = false;
+    return &victim->index;
+}
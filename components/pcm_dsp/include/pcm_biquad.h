@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Coefficients are Q28, which leaves room for the b terms of a +12 dB shelf. */
+#define PCM_BIQUAD_FRAC_BITS 28
+/* Fraction bits of the output kept in the feedback state. */
+#define PCM_BIQUAD_STATE_BITS 12
+
+typedef enum {
+    PCM_BIQUAD_PEAK,
+    PCM_BIQUAD_LOW_SHELF,
+    PCM_BIQUAD_HIGH_SHELF,
+} pcm_biquad_type_t;
+
+/*
+ * One second-order section on interleaved stereo, direct form I. The poles
+ * of a low shelf sit close to z = 1, so the feedback runs on outputs with
+ * extra fraction bits rather than on the rounded 16-bit samples. That makes
+ * every product Q28 x 32-bit into a 64-bit sum: unlike the volume and
+ * resampler loops this is not 16 x 16-bit work, so it cannot use the
+ * ESP32's MAC16 unit and costs several 32-bit multiplies per tap.
+ */
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+    int16_t x1[2], x2[2];
+    int32_t y1[2], y2[2];
+} pcm_biquad_t;
+
+/*
+ * Designs an Audio EQ Cookbook filter and clears the state. Q sets the
+ * bandwidth of a peak and the slope of a shelf (0.707 for a plain shelf).
+ */
+esp_err_t pcm_biquad_design(pcm_biquad_t *bq, pcm_biquad_type_t type, uint32_t sample_rate, float freq, float q,
+                            float gain_db);
+
+void pcm_biquad_reset(pcm_biquad_t *bq);
+
+/* Filters interleaved stereo frames in place, saturating to 16 bits. */
+void pcm_biquad_process(pcm_biquad_t *bq, int16_t *frames, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Rational polyphase resampler for interleaved stereo int16. The rate
+ * ratio out/in is reduced to L/M; a windowed-sinc prototype of
+ * L * PCM_RESAMPLER_TAPS taps is split into L phases of Q15 taps, and each
+ * output frame is one PCM_RESAMPLER_TAPS-tap dot product per channel.
+ * 48 kHz -> 44.1 kHz is 147/160, 22.05 kHz -> 44.1 kHz is 2/1 and
+ * 32, 16 and 8 kHz -> 44.1 kHz need 441 phases, 28 KB of taps.
+ */
+#define PCM_RESAMPLER_TAPS 32
+/* Every MPEG audio rate into 44.1 or 48 kHz; 11.025 kHz -> 48 kHz is the most, 640/147. */
+#define PCM_RESAMPLER_MAX_PHASES 640
+/* Input is deinterleaved into the filter history this many frames at a time. */
+#define PCM_RESAMPLER_BLOCK_FRAMES 256
+
+typedef struct pcm_resampler pcm_resampler_t;
+
+/* ESP_ERR_NOT_SUPPORTED when the reduced ratio needs more than PCM_RESAMPLER_MAX_PHASES phases. */
+esp_err_t pcm_resampler_create(uint32_t in_rate, uint32_t out_rate, pcm_resampler_t **out);
+void pcm_resampler_destroy(pcm_resampler_t *rs);
+
+/* Clears the filter history, e.g. after a seek. */
+void pcm_resampler_reset(pcm_resampler_t *rs);
+
+/*
+ * Produces up to out_frames frames. On entry *in_frames is the input
+ * available, on return the number taken; input that was taken but not yet
+ * needed is kept, so the caller can release it. Returns frames written.
+ */
+size_t pcm_resampler_process(pcm_resampler_t *rs, const int16_t *in, size_t *in_frames, int16_t *out,
+                             size_t out_frames);
+
+/* Input frames of latency the filter adds: half its length, in input samples. */
+float pcm_resampler_delay(const pcm_resampler_t *rs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Gains are Q15 with unity at 1 << 15; the ramp runs in Q31 so slow fades still move every frame. */
+#define PCM_VOLUME_UNITY (1 << 15)
+
+typedef struct {
+    uint32_t gain;              /* Q31, current */
+    uint32_t target;            /* Q31 */
+    int32_t step;               /* Q31 per frame while ramping */
+    uint32_t remaining;         /* frames left in the ramp */
+} pcm_volume_t;
+
+void pcm_volume_init(pcm_volume_t *vol, int32_t gain_q15);
+
+/* Ramps linearly to gain_q15 (clamped to [0, unity]) over ramp_frames; 0 jumps. */
+void pcm_volume_set(pcm_volume_t *vol, int32_t gain_q15, uint32_t ramp_frames);
+
+/* Q15 gain for an attenuation in dB (<= 0); at or below -96 dB it is silence. */
+int32_t pcm_volume_gain_from_db(float db);
+
+/* Scales interleaved stereo frames in place. Unity and silence cost no multiplies. */
+void pcm_volume_process(pcm_volume_t *vol, int16_t *frames, size_t n);
+
+#ifdef __cplusplus
+}
+#endif
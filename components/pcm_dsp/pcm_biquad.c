@@ -0,0 +1,107 @@
+#include "pcm_biquad.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#define CHANNELS 2
+/* Coefficients must fit a signed 32-bit Q28 value. */
+#define COEFF_LIMIT ((double)(1 << (31 - PCM_BIQUAD_FRAC_BITS)))
+/* Saturating the state keeps the rounded output within 16 bits. */
+#define STATE_HALF (1 << (PCM_BIQUAD_STATE_BITS - 1))
+#define STATE_MAX ((INT16_MAX << PCM_BIQUAD_STATE_BITS) + STATE_HALF - 1)
+#define STATE_MIN (INT16_MIN * (1 << PCM_BIQUAD_STATE_BITS))
+
+static bool to_fixed(double value, int32_t *out) {
+    if (fabs(value) >= COEFF_LIMIT) {
+        return false;
+    }
+    *out = (int32_t)lround(value * (1 << PCM_BIQUAD_FRAC_BITS));
+    return true;
+}
+
+esp_err_t pcm_biquad_design(pcm_biquad_t *bq, pcm_biquad_type_t type, uint32_t sample_rate, float freq, float q,
+                            float gain_db) {
+    if (sample_rate == 0 || freq <= 0.0f || freq >= sample_rate / 2.0f || q <= 0.0f) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    double a = pow(10.0, gain_db / 40.0);
+    double w0 = 2.0 * M_PI * freq / sample_rate;
+    double cosw = cos(w0);
+    double alpha = sin(w0) / (2.0 * q);
+    double shelf = 2.0 * sqrt(a) * alpha;
+    double b0, b1, b2, a0, a1, a2;
+
+    switch (type) {
+    case PCM_BIQUAD_PEAK:
+        b0 = 1.0 + alpha * a;
+        b1 = -2.0 * cosw;
+        b2 = 1.0 - alpha * a;
+        a0 = 1.0 + alpha / a;
+        a1 = -2.0 * cosw;
+        a2 = 1.0 - alpha / a;
+        break;
+    case PCM_BIQUAD_LOW_SHELF:
+        b0 = a * ((a + 1.0) - (a - 1.0) * cosw + shelf);
+        b1 = 2.0 * a * ((a - 1.0) - (a + 1.0) * cosw);
+        b2 = a * ((a + 1.0) - (a - 1.0) * cosw - shelf);
+        a0 = (a + 1.0) + (a - 1.0) * cosw + shelf;
+        a1 = -2.0 * ((a - 1.0) + (a + 1.0) * cosw);
+        a2 = (a + 1.0) + (a - 1.0) * cosw - shelf;
+        break;
+    case PCM_BIQUAD_HIGH_SHELF:
+        b0 = a * ((a + 1.0) + (a - 1.0) * cosw + shelf);
+        b1 = -2.0 * a * ((a - 1.0) + (a + 1.0) * cosw);
+        b2 = a * ((a + 1.0) + (a - 1.0) * cosw - shelf);
+        a0 = (a + 1.0) - (a - 1.0) * cosw + shelf;
+        a1 = 2.0 * ((a - 1.0) - (a + 1.0) * cosw);
+        a2 = (a + 1.0) - (a - 1.0) * cosw - shelf;
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+    pcm_biquad_t design;
+    if (!to_fixed(b0 / a0, &design.b0) || !to_fixed(b1 / a0, &design.b1) || !to_fixed(b2 / a0, &design.b2) ||
+        !to_fixed(a1 / a0, &design.a1) || !to_fixed(a2 / a0, &design.a2)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pcm_biquad_reset(&design);
+    *bq = design;
+    return ESP_OK;
+}
+
+void pcm_biquad_reset(pcm_biquad_t *bq) {
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        bq->x1[ch] = bq->x2[ch] = 0;
+        bq->y1[ch] = bq->y2[ch] = 0;
+    }
+}
+
+void pcm_biquad_process(pcm_biquad_t *bq, int16_t *frames, size_t n) {
+    const int64_t b0 = bq->b0, b1 = bq->b1, b2 = bq->b2, a1 = bq->a1, a2 = bq->a2;
+
+    /* One channel per pass keeps its whole state in registers. */
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        int32_t x1 = bq->x1[ch], x2 = bq->x2[ch];
+        int32_t y1 = bq->y1[ch], y2 = bq->y2[ch];
+        int16_t *s = frames + ch;
+        for (size_t i = 0; i < n; i++, s += CHANNELS) {
+            int32_t x = *s;
+            int64_t acc = (b0 * x + b1 * x1 + b2 * x2) * (1 << PCM_BIQUAD_STATE_BITS) - a1 * y1 - a2 * y2;
+            int64_t y = acc >> PCM_BIQUAD_FRAC_BITS;
+            if (y > STATE_MAX) {
+                y = STATE_MAX;
+            } else if (y < STATE_MIN) {
+                y = STATE_MIN;
+            }
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = (int32_t)y;
+            *s = (int16_t)((y1 + STATE_HALF) >> PCM_BIQUAD_STATE_BITS);
+        }
+        bq->x1[ch] = (int16_t)x1;
+        bq->x2[ch] = (int16_t)x2;
+        bq->y1[ch] = y1;
+        bq->y2[ch] = y2;
+    }
+}
@@ -0,0 +1,194 @@
+#include "pcm_resampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHANNELS 2
+#define HISTORY_FRAMES (PCM_RESAMPLER_TAPS - 1 + PCM_RESAMPLER_BLOCK_FRAMES)
+/*
+ * Kaiser window and cutoff, as a fraction of the lower Nyquist rate. For
+ * 48 kHz -> 44.1 kHz the passband is flat past 16 kHz and a 23.5 kHz tone,
+ * which would alias to 20.6 kHz, is down 70 dB.
+ */
+#define KAISER_BETA 7.0f
+#define CUTOFF 0.90f
+#define Q15_ONE (1 << 15)
+
+struct pcm_resampler {
+    uint32_t up;                /* L */
+    uint32_t step_int;          /* M / L */
+    uint32_t step_frac;         /* M % L */
+    uint32_t phase;             /* of the next output, in [0, L) */
+    uint32_t pos;               /* history index of the newest sample under the next output */
+    uint32_t fill;              /* valid frames in history */
+    int16_t history[CHANNELS][HISTORY_FRAMES];
+    /* L phases of PCM_RESAMPLER_TAPS, each reversed so the dot product walks history forwards. */
+    int16_t taps[];
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * Zeroth-order modified Bessel function, by its power series. The design
+ * runs in single precision, which the ESP32 FPU does in hardware and which
+ * is well beyond Q15.
+ */
+static float bessel_i0(float x) {
+    float sum = 1.0f, term = 1.0f;
+    for (int k = 1; term > sum * 1e-8f; k++) {
+        term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static void design(pcm_resampler_t *rs, uint32_t up, uint32_t down) {
+    size_t len = (size_t)up * PCM_RESAMPLER_TAPS;
+    float center = (len - 1) / 2.0f;
+    /* Cycles per sample at the upsampled rate. */
+    float fc = 0.5f * CUTOFF / (up > down ? up : down);
+    float norm = bessel_i0(KAISER_BETA);
+    float h[PCM_RESAMPLER_TAPS];
+
+    for (uint32_t p = 0; p < up; p++) {
+        float sum = 0.0f;
+        for (int j = 0; j < PCM_RESAMPLER_TAPS; j++) {
+            float t = p + (float)j * up - center;
+            float r = t / center;
+            float window = bessel_i0(KAISER_BETA * sqrtf(fmaxf(0.0f, 1.0f - r * r))) / norm;
+            float x = 2.0f * fc * t;
+            h[j] = window * (x == 0.0f ? 1.0f : sinf((float)M_PI * x) / ((float)M_PI * x));
+            sum += h[j];
+        }
+        /* Every phase gets exactly unity DC gain, so the phases cannot modulate a constant. */
+        int16_t *taps = rs->taps + p * PCM_RESAMPLER_TAPS;
+        int32_t total = 0;
+        int peak = 0;
+        for (int j = 0; j < PCM_RESAMPLER_TAPS; j++) {
+            taps[PCM_RESAMPLER_TAPS - 1 - j] = (int16_t)lroundf(h[j] / sum * Q15_ONE);
+            total += taps[PCM_RESAMPLER_TAPS - 1 - j];
+            peak = h[j] > h[peak] ? j : peak;
+        }
+        taps[PCM_RESAMPLER_TAPS - 1 - peak] += Q15_ONE - total;
+    }
+}
+
+esp_err_t pcm_resampler_create(uint32_t in_rate, uint32_t out_rate, pcm_resampler_t **out) {
+    if (in_rate == 0 || out_rate == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    uint32_t g = gcd(in_rate, out_rate);
+    uint32_t up = out_rate / g;
+    uint32_t down = in_rate / g;
+    if (up > PCM_RESAMPLER_MAX_PHASES) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    pcm_resampler_t *rs = malloc(sizeof(*rs) + (size_t)up * PCM_RESAMPLER_TAPS * sizeof(int16_t));
+    if (rs == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    rs->up = up;
+    rs->step_int = down / up;
+    rs->step_frac = down % up;
+    design(rs, up, down);
+    pcm_resampler_reset(rs);
+    *out = rs;
+    return ESP_OK;
+}
+
+void pcm_resampler_destroy(pcm_resampler_t *rs) {
+    free(rs);
+}
+
+void pcm_resampler_reset(pcm_resampler_t *rs) {
+    memset(rs->history, 0, sizeof(rs->history));
+    rs->phase = 0;
+    rs->pos = PCM_RESAMPLER_TAPS - 1;
+    rs->fill = PCM_RESAMPLER_TAPS - 1;
+}
+
+static inline int16_t saturate(int32_t acc) {
+    acc >>= 15;
+    return acc > INT16_MAX ? INT16_MAX : acc < INT16_MIN ? INT16_MIN : (int16_t)acc;
+}
+
+/* Moves the next input block into the per-channel history, first dropping what no window reaches any more. */
+static size_t load(pcm_resampler_t *rs, const int16_t *in, size_t frames) {
+    if (rs->fill == HISTORY_FRAMES) {
+        uint32_t drop = rs->fill - (PCM_RESAMPLER_TAPS - 1);
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            memmove(rs->history[ch], rs->history[ch] + drop, (PCM_RESAMPLER_TAPS - 1) * sizeof(int16_t));
+        }
+        rs->pos -= drop;
+        rs->fill -= drop;
+    }
+    size_t count = HISTORY_FRAMES - rs->fill;
+    if (count > frames) {
+        count = frames;
+    }
+    int16_t *left = rs->history[0] + rs->fill;
+    int16_t *right = rs->history[1] + rs->fill;
+    for (size_t i = 0; i < count; i++) {
+        left[i] = in[CHANNELS * i];
+        right[i] = in[CHANNELS * i + 1];
+    }
+    rs->fill += count;
+    return count;
+}
+
+size_t pcm_resampler_process(pcm_resampler_t *rs, const int16_t *in, size_t *in_frames, int16_t *out,
+                             size_t out_frames) {
+    size_t avail = *in_frames;
+    size_t taken = 0;
+    size_t produced = 0;
+
+    while (produced < out_frames) {
+        if (rs->pos >= rs->fill) {
+            if (taken == avail) {
+                break;
+            }
+            taken += load(rs, in + CHANNELS * taken, avail - taken);
+            continue;
+        }
+        /*
+         * Fixed trip count, 16-bit operands and 32-bit accumulators: the
+         * shape the compiler unrolls into multiply-accumulates. Each phase
+         * sums to 1.0 with well under 2.0 of absolute tap weight, so the
+         * accumulators cannot overflow.
+         */
+        const int16_t *restrict taps = rs->taps + rs->phase * PCM_RESAMPLER_TAPS;
+        const int16_t *restrict left = rs->history[0] + rs->pos - (PCM_RESAMPLER_TAPS - 1);
+        const int16_t *restrict right = rs->history[1] + rs->pos - (PCM_RESAMPLER_TAPS - 1);
+        int32_t acc_l = 1 << 14;
+        int32_t acc_r = 1 << 14;
+#pragma GCC unroll 8
+        for (int j = 0; j < PCM_RESAMPLER_TAPS; j++) {
+            acc_l += taps[j] * left[j];
+            acc_r += taps[j] * right[j];
+        }
+        out[CHANNELS * produced] = saturate(acc_l);
+        out[CHANNELS * produced + 1] = saturate(acc_r);
+        produced++;
+
+        rs->pos += rs->step_int;
+        rs->phase += rs->step_frac;
+        if (rs->phase >= rs->up) {
+            rs->phase -= rs->up;
+            rs->pos++;
+        }
+    }
+    *in_frames = taken;
+    return produced;
+}
+
+float pcm_resampler_delay(const pcm_resampler_t *rs) {
+    return (rs->up * PCM_RESAMPLER_TAPS - 1) / (2.0f * rs->up);
+}
@@ -0,0 +1,80 @@
+#include "pcm_volume.h"
+
+#include <math.h>
+#include <string.h>
+
+#define CHANNELS 2
+#define Q31_TO_Q15 16
+#define SILENCE_DB -96.0f
+
+static uint32_t to_q31(int32_t gain_q15) {
+    if (gain_q15 < 0) {
+        gain_q15 = 0;
+    } else if (gain_q15 > PCM_VOLUME_UNITY) {
+        gain_q15 = PCM_VOLUME_UNITY;
+    }
+    return (uint32_t)gain_q15 << Q31_TO_Q15;
+}
+
+/* g <= unity, so the product fits and the result needs no saturation. */
+static void scale(int16_t *samples, size_t count, int32_t g) {
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = (int16_t)((samples[i] * g + (1 << 14)) >> 15);
+    }
+}
+
+void pcm_volume_init(pcm_volume_t *vol, int32_t gain_q15) {
+    vol->gain = to_q31(gain_q15);
+    vol->target = vol->gain;
+    vol->step = 0;
+    vol->remaining = 0;
+}
+
+void pcm_volume_set(pcm_volume_t *vol, int32_t gain_q15, uint32_t ramp_frames) {
+    vol->target = to_q31(gain_q15);
+    if (ramp_frames == 0 || vol->target == vol->gain) {
+        vol->gain = vol->target;
+        vol->step = 0;
+        vol->remaining = 0;
+        return;
+    }
+    /* Truncated, so the ramp never overshoots; the last frame lands on target exactly. */
+    vol->step = (int32_t)(((int64_t)vol->target - vol->gain) / ramp_frames);
+    vol->remaining = ramp_frames;
+}
+
+int32_t pcm_volume_gain_from_db(float db) {
+    if (db >= 0.0f) {
+        return PCM_VOLUME_UNITY;
+    }
+    if (db <= SILENCE_DB) {
+        return 0;
+    }
+    return (int32_t)lroundf(PCM_VOLUME_UNITY * powf(10.0f, db / 20.0f));
+}
+
+void pcm_volume_process(pcm_volume_t *vol, int16_t *frames, size_t n) {
+    if (vol->remaining > 0) {
+        size_t ramp = n < vol->remaining ? n : vol->remaining;
+        uint32_t gain = vol->gain;
+        for (size_t i = 0; i < ramp; i++) {
+            int32_t g = (int32_t)(gain >> Q31_TO_Q15);
+            frames[CHANNELS * i] = (int16_t)((frames[CHANNELS * i] * g + (1 << 14)) >> 15);
+            frames[CHANNELS * i + 1] = (int16_t)((frames[CHANNELS * i + 1] * g + (1 << 14)) >> 15);
+            gain += (uint32_t)vol->step;
+        }
+        vol->remaining -= ramp;
+        vol->gain = vol->remaining > 0 ? gain : vol->target;
+        frames += CHANNELS * ramp;
+        n -= ramp;
+    }
+    int32_t g = (int32_t)(vol->gain >> Q31_TO_Q15);
+    if (g == PCM_VOLUME_UNITY || n == 0) {
+        return;
+    }
+    if (g == 0) {
+        memset(frames, 0, n * CHANNELS * sizeof(int16_t));
+        return;
+    }
+    scale(frames, n * CHANNELS, g);
+}
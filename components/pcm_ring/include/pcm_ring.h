@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PCM_RING_CHANNELS 2
+#define PCM_RING_FRAME_BYTES (PCM_RING_CHANNELS * sizeof(int16_t))
+
+/* Keeps producer and consumer state on separate lines and satisfies I2S/SPI DMA word alignment. */
+#define PCM_RING_CACHE_LINE 32
+#define PCM_RING_STORAGE_ALIGN PCM_RING_CACHE_LINE
+
+/*
+ * Single-producer/single-consumer ring of interleaved stereo int16 frames.
+ * Positions run over [0, 2 * capacity) so full and empty are distinguishable
+ * without a division and for any capacity. A producer that needs whole
+ * blocks (e.g. decoded MP3 frames) reserves them with
+ * pcm_ring_write_reserve_block(), which leaves a tail too short for the
+ * block unused and wraps; the consumer steps over it.
+ */
+typedef struct {
+    _Alignas(PCM_RING_CACHE_LINE) atomic_uint_least32_t write_pos;
+    atomic_uint_least32_t wrap_pos;     /* where the producer left the tail unused, or PCM_RING_NO_WRAP */
+    uint32_t pending_skip;              /* tail the next commit steps over */
+    uint32_t producer_waits;
+    bool had_space;
+    _Alignas(PCM_RING_CACHE_LINE) atomic_uint_least32_t read_pos;
+    uint32_t underruns;
+    bool had_data;
+    _Alignas(PCM_RING_CACHE_LINE) int16_t *frames;
+    uint32_t capacity;
+} pcm_ring_t;
+
+#define PCM_RING_NO_WRAP UINT32_MAX
+
+typedef struct {
+    uint32_t capacity;
+    uint32_t fill;
+    uint32_t underruns;         /* times the consumer ran dry after having had data */
+    uint32_t producer_waits;    /* times the producer found the ring full after having had space */
+} pcm_ring_stats_t;
+
+esp_err_t pcm_ring_init(pcm_ring_t *ring, int16_t *storage, size_t capacity_frames);
+
+/*
+ * Producer side. Points *frames at up to max_frames contiguous free frames
+ * and returns the count, 0 when the ring is full. Commit at most that many
+ * frames once written.
+ */
+size_t pcm_ring_write_reserve(pcm_ring_t *ring, int16_t **frames, size_t max_frames);
+
+/*
+ * Producer side, for whole blocks: points *frames at exactly `frames`
+ * contiguous free frames, wrapping early if they do not fit before the end
+ * of the ring. Returns false, reserving nothing, until there is room.
+ */
+bool pcm_ring_write_reserve_block(pcm_ring_t *ring, int16_t **frames, size_t frames_needed);
+void pcm_ring_write_commit(pcm_ring_t *ring, size_t frames);
+
+/*
+ * Consumer side. Points *frames at up to max_frames contiguous readable
+ * frames and returns the count, 0 when empty. The consumer may modify the
+ * span in place before releasing it.
+ */
+size_t pcm_ring_read_acquire(pcm_ring_t *ring, int16_t **frames, size_t max_frames);
+void pcm_ring_read_release(pcm_ring_t *ring, size_t frames);
+
+/* Fill includes a tail the producer skipped until the consumer steps over it. */
+size_t pcm_ring_fill(const pcm_ring_t *ring);
+size_t pcm_ring_space(const pcm_ring_t *ring);
+void pcm_ring_get_stats(const pcm_ring_t *ring, pcm_ring_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
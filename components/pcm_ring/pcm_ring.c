@@ -0,0 +1,156 @@
+#include "pcm_ring.h"
+
+static inline uint32_t ring_index(const pcm_ring_t *ring, uint32_t pos) {
+    return pos < ring->capacity ? pos : pos - ring->capacity;
+}
+
+static inline uint32_t ring_advance(const pcm_ring_t *ring, uint32_t pos, uint32_t frames) {
+    pos += frames;
+    return pos < 2 * ring->capacity ? pos : pos - 2 * ring->capacity;
+}
+
+static inline uint32_t ring_distance(const pcm_ring_t *ring, uint32_t write, uint32_t read) {
+    return write >= read ? write - read : write + 2 * ring->capacity - read;
+}
+
+esp_err_t pcm_ring_init(pcm_ring_t *ring, int16_t *storage, size_t capacity_frames) {
+    if (storage == NULL || capacity_frames == 0 || capacity_frames > UINT32_MAX / 4 ||
+        ((uintptr_t)storage % PCM_RING_STORAGE_ALIGN) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_init(&ring->write_pos, 0);
+    atomic_init(&ring->wrap_pos, PCM_RING_NO_WRAP);
+    atomic_init(&ring->read_pos, 0);
+    ring->pending_skip = 0;
+    ring->producer_waits = 0;
+    ring->had_space = true;
+    ring->underruns = 0;
+    ring->had_data = false;
+    ring->frames = storage;
+    ring->capacity = capacity_frames;
+    return ESP_OK;
+}
+
+static inline uint32_t write_space(pcm_ring_t *ring, uint32_t write) {
+    uint32_t read = atomic_load_explicit(&ring->read_pos, memory_order_acquire);
+    return ring->capacity - ring_distance(ring, write, read);
+}
+
+/* Counts a wait once per stretch of full ring, not once per poll. */
+static inline void note_space(pcm_ring_t *ring, bool available) {
+    if (!available && ring->had_space) {
+        ring->producer_waits++;
+    }
+    ring->had_space = available;
+}
+
+size_t pcm_ring_write_reserve(pcm_ring_t *ring, int16_t **frames, size_t max_frames) {
+    uint32_t write = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+    uint32_t space = write_space(ring, write);
+    ring->pending_skip = 0;
+    note_space(ring, space > 0);
+    if (space == 0) {
+        return 0;
+    }
+    uint32_t index = ring_index(ring, write);
+    uint32_t n = ring->capacity - index;
+    if (n > space) {
+        n = space;
+    }
+    if (n > max_frames) {
+        n = max_frames;
+    }
+    *frames = &ring->frames[index * PCM_RING_CHANNELS];
+    return n;
+}
+
+bool pcm_ring_write_reserve_block(pcm_ring_t *ring, int16_t **frames, size_t frames_needed) {
+    uint32_t write = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+    uint32_t space = write_space(ring, write);
+    uint32_t index = ring_index(ring, write);
+    uint32_t tail = ring->capacity - index;
+    /* Too short for the block: leave the tail unused and start over at index 0. */
+    uint32_t skip = tail < frames_needed ? tail : 0;
+    bool fits = frames_needed <= ring->capacity && skip + frames_needed <= space;
+    note_space(ring, fits);
+    if (!fits) {
+        return false;
+    }
+    ring->pending_skip = skip;
+    *frames = &ring->frames[(skip ? 0 : index) * PCM_RING_CHANNELS];
+    return true;
+}
+
+void pcm_ring_write_commit(pcm_ring_t *ring, size_t frames) {
+    uint32_t write = atomic_load_explicit(&ring->write_pos, memory_order_relaxed);
+    if (ring->pending_skip) {
+        /* Published by the write_pos store below, before the consumer can reach it. */
+        atomic_store_explicit(&ring->wrap_pos, write, memory_order_relaxed);
+        write = ring_advance(ring, write, ring->pending_skip);
+        ring->pending_skip = 0;
+    }
+    atomic_store_explicit(&ring->write_pos, ring_advance(ring, write, frames), memory_order_release);
+}
+
+size_t pcm_ring_read_acquire(pcm_ring_t *ring, int16_t **frames, size_t max_frames) {
+    uint32_t read = atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+    uint32_t write = atomic_load_explicit(&ring->write_pos, memory_order_acquire);
+    uint32_t fill = ring_distance(ring, write, read);
+    uint32_t wrap = atomic_load_explicit(&ring->wrap_pos, memory_order_relaxed);
+    if (fill != 0 && read == wrap) {
+        /*
+         * Step over the tail the producer skipped. The marker is cleared
+         * before the release below hands the space back, so the producer
+         * never sets the next one while this one is pending.
+         */
+        uint32_t skip = ring->capacity - ring_index(ring, read);
+        atomic_store_explicit(&ring->wrap_pos, PCM_RING_NO_WRAP, memory_order_relaxed);
+        read = ring_advance(ring, read, skip);
+        atomic_store_explicit(&ring->read_pos, read, memory_order_release);
+        fill -= skip;
+        wrap = PCM_RING_NO_WRAP;
+    }
+    if (fill == 0) {
+        if (ring->had_data) {
+            ring->underruns++;
+            ring->had_data = false;
+        }
+        return 0;
+    }
+    ring->had_data = true;
+    uint32_t index = ring_index(ring, read);
+    uint32_t n = ring->capacity - index;
+    if (n > fill) {
+        n = fill;
+    }
+    /* A skipped tail ahead ends this span early. */
+    if (wrap != PCM_RING_NO_WRAP && ring_distance(ring, wrap, read) < n) {
+        n = ring_distance(ring, wrap, read);
+    }
+    if (n > max_frames) {
+        n = max_frames;
+    }
+    *frames = &ring->frames[index * PCM_RING_CHANNELS];
+    return n;
+}
+
+void pcm_ring_read_release(pcm_ring_t *ring, size_t frames) {
+    uint32_t read = atomic_load_explicit(&ring->read_pos, memory_order_relaxed);
+    atomic_store_explicit(&ring->read_pos, ring_advance(ring, read, frames), memory_order_release);
+}
+
+size_t pcm_ring_fill(const pcm_ring_t *ring) {
+    return ring_distance(ring, atomic_load_explicit(&ring->write_pos, memory_order_acquire),
+                         atomic_load_explicit(&ring->read_pos, memory_order_acquire));
+}
+
+size_t pcm_ring_space(const pcm_ring_t *ring) {
+    return ring->capacity - pcm_ring_fill(ring);
+}
+
+void pcm_ring_get_stats(const pcm_ring_t *ring, pcm_ring_stats_t *stats) {
+    stats->capacity = ring->capacity;
+    stats->fill = pcm_ring_fill(ring);
+    stats->underruns = ring->underruns;
+    stats->producer_waits = ring->producer_waits;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SSD1306_WIDTH 128
+#define SSD1306_PAGES 8
+#define SSD1306_FB_SIZE (SSD1306_WIDTH * SSD1306_PAGES)
+
+#define SSD1306_CONTROL_CMD 0x00
+#define SSD1306_CONTROL_DATA 0x40
+
+#define SSD1306_GLYPH_WIDTH 6
+
+/* One bus transaction: control byte followed by len bytes of payload. */
+typedef esp_err_t (*ssd1306_write_fn)(void *ctx, uint8_t control, const uint8_t *data, size_t len);
+
+/*
+ * In-RAM copy of the panel GDDRAM. Drawing only touches fb and widens the
+ * per-page dirty column range; ssd1306_flush() pushes each dirty range as a
+ * single data burst using horizontal addressing mode.
+ */
+typedef struct {
+    ssd1306_write_fn write;
+    void *ctx;
+    uint8_t dirty_first[SSD1306_PAGES];
+    uint8_t dirty_last[SSD1306_PAGES];
+    uint8_t fb[SSD1306_FB_SIZE];
+} ssd1306_t;
+
+void ssd1306_setup(ssd1306_t *dev, ssd1306_write_fn write, void *ctx);
+
+/* Sends the power-up sequence and marks the whole panel dirty, since its RAM contents are unknown. */
+esp_err_t ssd1306_init(ssd1306_t *dev);
+
+void ssd1306_clear(ssd1306_t *dev);
+void ssd1306_clear_page(ssd1306_t *dev, uint8_t page);
+
+/* Writes raw column bytes starting at (page, col), wrapping to the next page like the controller does. */
+size_t ssd1306_write(ssd1306_t *dev, uint8_t page, uint8_t col, const uint8_t *data, size_t len);
+
+/* Draws A-Z glyphs, skipping other characters. Returns the number of glyphs drawn. */
+size_t ssd1306_draw_text(ssd1306_t *dev, uint8_t page, uint8_t col, const char *text, size_t len);
+
+bool ssd1306_is_dirty(const ssd1306_t *dev);
+esp_err_t ssd1306_flush(ssd1306_t *dev);
+
+#ifdef __cplusplus
+}
+#endif
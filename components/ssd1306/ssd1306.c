@@ -0,0 +1,188 @@
+#include "ssd1306.h"
+
+#include <string.h>
+
+#define PAGE_CLEAN 0xFF
+
+static const uint8_t font5x7[][5] = {
+    {0x7E,0x11,0x11,0x7E,0x00}, {0x7F,0x49,0x49,0x36,0x00}, {0x3E,0x41,0x41,0x22,0x00},
+    {0x7F,0x41,0x41,0x3E,0x00}, {0x7F,0x49,0x49,0x41,0x00}, {0x7F,0x09,0x09,0x01,0x00},
+    {0x3E,0x41,0x51,0x32,0x00}, {0x7F,0x08,0x08,0x7F,0x00}, {0x41,0x7F,0x41,0x00,0x00},
+    {0x20,0x40,0x41,0x3F,0x00}, {0x7F,0x08,0x14,0x63,0x00}, {0x7F,0x40,0x40,0x40,0x00},
+    {0x7F,0x02,0x04,0x02,0x7F}, {0x7F,0x06,0x18,0x7F,0x00}, {0x3E,0x41,0x41,0x3E,0x00},
+    {0x7F,0x09,0x09,0x06,0x00}, {0x3E,0x41,0x61,0x7E,0x00}, {0x7F,0x09,0x19,0x66,0x00},
+    {0x46,0x49,0x49,0x31,0x00}, {0x01,0x7F,0x01,0x01,0x00}, {0x3F,0x40,0x40,0x3F,0x00},
+    {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F}, {0x63,0x14,0x08,0x14,0x63},
+    {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}
+};
+
+static const uint8_t init_seq[] = {
+    0xAE,
+    0x20, 0x00,
+    0xB0,
+    0xC8,
+    0x00,
+    0x10,
+    0x40,
+    0x81, 0xFF,
+    0xA1,
+    0xA6,
+    0xA8, 0x3F,
+    0xA4,
+    0xD3, 0x00,
+    0xD5, 0xF0,
+    0xD9, 0x22,
+    0xDA, 0x12,
+    0xDB, 0x20,
+    0x8D, 0x14,
+    0xAF,
+};
+
+static void mark_dirty(ssd1306_t *dev, uint8_t page, uint8_t first, uint8_t last) {
+    if (dev->dirty_first[page] == PAGE_CLEAN) {
+        dev->dirty_first[page] = first;
+        dev->dirty_last[page] = last;
+        return;
+    }
+    if (first < dev->dirty_first[page]) {
+        dev->dirty_first[page] = first;
+    }
+    if (last > dev->dirty_last[page]) {
+        dev->dirty_last[page] = last;
+    }
+}
+
+static void mark_clean(ssd1306_t *dev, uint8_t page) {
+    dev->dirty_first[page] = PAGE_CLEAN;
+    dev->dirty_last[page] = 0;
+}
+
+static bool page_full_width(const ssd1306_t *dev, uint8_t page) {
+    return dev->dirty_first[page] == 0 && dev->dirty_last[page] == SSD1306_WIDTH - 1;
+}
+
+/* Only bytes that actually change widen the dirty range, so redrawing identical content costs no bus time. */
+static void put_byte(ssd1306_t *dev, size_t offset, uint8_t value) {
+    if (dev->fb[offset] == value) {
+        return;
+    }
+    dev->fb[offset] = value;
+    uint8_t col = offset % SSD1306_WIDTH;
+    mark_dirty(dev, offset / SSD1306_WIDTH, col, col);
+}
+
+void ssd1306_setup(ssd1306_t *dev, ssd1306_write_fn write, void *ctx) {
+    memset(dev, 0, sizeof(*dev));
+    dev->write = write;
+    dev->ctx = ctx;
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        mark_clean(dev, page);
+    }
+}
+
+esp_err_t ssd1306_init(ssd1306_t *dev) {
+    esp_err_t err = dev->write(dev->ctx, SSD1306_CONTROL_CMD, init_seq, sizeof(init_seq));
+    if (err != ESP_OK) {
+        return err;
+    }
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        mark_dirty(dev, page, 0, SSD1306_WIDTH - 1);
+    }
+    return ESP_OK;
+}
+
+void ssd1306_clear_page(ssd1306_t *dev, uint8_t page) {
+    if (page >= SSD1306_PAGES) {
+        return;
+    }
+    size_t base = (size_t)page * SSD1306_WIDTH;
+    for (uint8_t col = 0; col < SSD1306_WIDTH; col++) {
+        put_byte(dev, base + col, 0x00);
+    }
+}
+
+void ssd1306_clear(ssd1306_t *dev) {
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        ssd1306_clear_page(dev, page);
+    }
+}
+
+size_t ssd1306_write(ssd1306_t *dev, uint8_t page, uint8_t col, const uint8_t *data, size_t len) {
+    if (page >= SSD1306_PAGES || col >= SSD1306_WIDTH) {
+        return 0;
+    }
+    size_t offset = (size_t)page * SSD1306_WIDTH + col;
+    size_t n = 0;
+    while (n < len && offset < SSD1306_FB_SIZE) {
+        put_byte(dev, offset++, data[n++]);
+    }
+    return n;
+}
+
+size_t ssd1306_draw_text(ssd1306_t *dev, uint8_t page, uint8_t col, const char *text, size_t len) {
+    static const uint8_t spacing = 0x00;
+    size_t drawn = 0;
+    for (size_t i = 0; i < len && text[i]; i++) {
+        char c = text[i];
+        if (c < 'A' || c > 'Z') {
+            continue;
+        }
+        size_t pos = (size_t)page * SSD1306_WIDTH + col + drawn * SSD1306_GLYPH_WIDTH;
+        if (pos + SSD1306_GLYPH_WIDTH > SSD1306_FB_SIZE) {
+            break;
+        }
+        ssd1306_write(dev, pos / SSD1306_WIDTH, pos % SSD1306_WIDTH, font5x7[c - 'A'], 5);
+        ssd1306_write(dev, (pos + 5) / SSD1306_WIDTH, (pos + 5) % SSD1306_WIDTH, &spacing, 1);
+        drawn++;
+    }
+    return drawn;
+}
+
+bool ssd1306_is_dirty(const ssd1306_t *dev) {
+    for (uint8_t page = 0; page < SSD1306_PAGES; page++) {
+        if (dev->dirty_first[page] != PAGE_CLEAN) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t send_window(ssd1306_t *dev, uint8_t first_page, uint8_t last_page, uint8_t first_col, uint8_t last_col) {
+    const uint8_t window[] = {
+        0x21, first_col, last_col,
+        0x22, first_page, last_page,
+    };
+    esp_err_t err = dev->write(dev->ctx, SSD1306_CONTROL_CMD, window, sizeof(window));
+    if (err != ESP_OK) {
+        return err;
+    }
+    /* Pages only merge when every one is full width, so the window is contiguous in fb. */
+    size_t start = (size_t)first_page * SSD1306_WIDTH + first_col;
+    size_t len = (size_t)(last_page - first_page) * SSD1306_WIDTH + (last_col - first_col) + 1;
+    return dev->write(dev->ctx, SSD1306_CONTROL_DATA, &dev->fb[start], len);
+}
+
+esp_err_t ssd1306_flush(ssd1306_t *dev) {
+    uint8_t page = 0;
+    while (page < SSD1306_PAGES) {
+        if (dev->dirty_first[page] == PAGE_CLEAN) {
+            page++;
+            continue;
+        }
+        uint8_t last_page = page;
+        if (page_full_width(dev, page)) {
+            while (last_page + 1 < SSD1306_PAGES && page_full_width(dev, last_page + 1)) {
+                last_page++;
+            }
+        }
+        esp_err_t err = send_window(dev, page, last_page, dev->dirty_first[page], dev->dirty_last[page]);
+        if (err != ESP_OK) {
+            return err;
+        }
+        for (uint8_t p = page; p <= last_page; p++) {
+            mark_clean(dev, p);
+        }
+        page = last_page + 1;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,57 @@
+#include "broadcast_ring.h"
+
+#include <string.h>
+
+esp_err_t broadcast_ring_init(broadcast_ring_t *ring, uint8_t *storage, size_t capacity) {
+    /* A power of two keeps offsets continuous when positions wrap. */
+    if (storage == NULL || capacity == 0 || capacity > INT32_MAX || (capacity & (capacity - 1)) != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->reserve, 0);
+    ring->data = storage;
+    ring->capacity = (uint32_t)capacity;
+    return ESP_OK;
+}
+
+void broadcast_ring_write(broadcast_ring_t *ring, const void *data, size_t len) {
+    const uint8_t *src = data;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (len > ring->capacity) {
+        src += len - ring->capacity;
+        head += (uint32_t)(len - ring->capacity);
+        len = ring->capacity;
+    }
+    /*
+     * Seqlock order: announce the bytes about to be overwritten before
+     * touching them, publish the new head after. A reader that sees the
+     * old reserve after using a span knows the span was not being written.
+     */
+    atomic_store_explicit(&ring->reserve, head + (uint32_t)len, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    uint32_t offset = head & (ring->capacity - 1);
+    size_t first = ring->capacity - offset < len ? ring->capacity - offset : len;
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, src + first, len - first);
+    atomic_store_explicit(&ring->head, head + (uint32_t)len, memory_order_release);
+}
+
+uint32_t broadcast_ring_head(const broadcast_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_acquire);
+}
+
+size_t broadcast_ring_peek(const broadcast_ring_t *ring, uint32_t pos, const uint8_t **data, size_t max) {
+    uint32_t avail = broadcast_ring_head(ring) - pos;
+    if (avail == 0 || avail > ring->capacity) {
+        return 0;
+    }
+    uint32_t offset = pos & (ring->capacity - 1);
+    size_t len = ring->capacity - offset < avail ? ring->capacity - offset : avail;
+    *data = ring->data + offset;
+    return len < max ? len : max;
+}
+
+bool broadcast_ring_intact(const broadcast_ring_t *ring, uint32_t pos) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&ring->reserve, memory_order_relaxed) - pos <= ring->capacity;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Single-writer byte ring read by any number of readers, each at its own
+ * position. The writer never waits: it overwrites the oldest bytes, and a
+ * reader that falls a whole ring behind finds its position no longer
+ * intact. Positions count bytes since init and wrap at 2^32; differences
+ * stay meaningful while readers are less than 2 GB behind.
+ */
+typedef struct {
+    atomic_uint_least32_t head;     /* bytes written; readable up to here */
+    atomic_uint_least32_t reserve;  /* head plus a write in progress */
+    uint8_t *data;
+    uint32_t capacity;
+} broadcast_ring_t;
+
+/* capacity must be a power of two. */
+esp_err_t broadcast_ring_init(broadcast_ring_t *ring, uint8_t *storage, size_t capacity);
+
+/* Writer side. Only the last `capacity` bytes of an oversized write are kept. */
+void broadcast_ring_write(broadcast_ring_t *ring, const void *data, size_t len);
+
+uint32_t broadcast_ring_head(const broadcast_ring_t *ring);
+
+/*
+ * Reader side, no copy: points *data at up to max contiguous bytes from pos
+ * and returns the count, 0 when pos is at the head. The bytes stay valid
+ * only while broadcast_ring_intact(pos) holds, so check it again after
+ * using them.
+ */
+size_t broadcast_ring_peek(const broadcast_ring_t *ring, uint32_t pos, const uint8_t **data, size_t max);
+
+/* False once the writer has started overwriting the byte at pos. */
+bool broadcast_ring_intact(const broadcast_ring_t *ring, uint32_t pos);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define STREAM_RELAY_URI "/stream.mp3"
+
+typedef struct {
+    size_t buffer_size;         /* shared by every listener; a power of two */
+    uint8_t max_clients;
+    uint8_t max_skips;          /* laps in a row, without catching up, before a drop */
+    uint16_t max_chunk;         /* payload bytes per HTTP chunk */
+} stream_relay_config_t;
+
+#define STREAM_RELAY_DEFAULT_CONFIG() { \
+    .buffer_size = 32 * 1024,           \
+    .max_clients = 4,                   \
+    .max_skips = 3,                     \
+    .max_chunk = 1436,                  \
+}
+
+typedef struct {
+    uint32_t clients;
+    uint32_t peak_clients;
+    uint32_t accepted;
+    uint32_t rejected;          /* turned away while every slot was taken */
+    uint32_t skips;             /* listeners moved forward to the live edge */
+    uint32_t dropped;
+    uint32_t client_bytes;      /* relay state per listener slot, besides socket buffers */
+    uint64_t bytes_in;
+    uint64_t bytes_out;         /* payload actually sent, summed over listeners */
+} stream_relay_stats_t;
+
+typedef struct stream_relay *stream_relay_handle_t;
+
+/*
+ * Allocates the broadcast ring and every listener slot once, and serves
+ * STREAM_RELAY_URI on server. Listeners join half a ring behind the live
+ * edge, so their players can start at once.
+ */
+esp_err_t stream_relay_start(httpd_handle_t server, const stream_relay_config_t *config,
+                             stream_relay_handle_t *out);
+
+/*
+ * Appends to the broadcast and has the server task push it to listeners.
+ * Never blocks; meant to be fed straight from the upstream reader.
+ * Listeners keep being served from the ring when writes pause.
+ */
+void stream_relay_write(stream_relay_handle_t relay, const void *data, size_t len);
+
+/*
+ * Ends the broadcast: each listener gets what is left in the ring, then
+ * the end of the chunked body, and is closed. Call once the upstream is
+ * done; listeners joining later only get the tail of the ring.
+ */
+void stream_relay_finish(stream_relay_handle_t relay);
+
+void stream_relay_get_stats(stream_relay_handle_t relay, stream_relay_stats_t *stats);
+
+/* Frees the relay. Stop the server first: it still holds the listeners' sessions. */
+void stream_relay_stop(stream_relay_handle_t relay);
+
+#ifdef __cplusplus
+}
+#endif
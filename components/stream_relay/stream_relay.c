@@ -0,0 +1,332 @@
+#include "stream_relay.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "esp_log.h"
+#include "broadcast_ring.h"
+
+#define CHUNK_HEADER_MAX 8      /* "ffff\r\n" */
+#define CHUNK_TRAILER "\r\n"
+#define CHUNK_TRAILER_LEN 2
+#define LAST_CHUNK "0\r\n\r\n"
+/* How soon a listener whose socket was full is tried again when no write comes first. */
+#define RETRY_MS 20
+
+static const char *TAG = "RELAY";
+
+typedef struct stream_relay stream_relay_t;
+
+static const char response_headers[] = "HTTP/1.1 200 OK\r\n"
+                                       "Content-Type: audio/mpeg\r\n"
+                                       "Transfer-Encoding: chunked\r\n"
+                                       "Cache-Control: no-cache, no-store\r\n"
+                                       "Connection: close\r\n"
+                                       "\r\n";
+
+/*
+ * Everything a listener costs the relay. The payload is sent straight from
+ * the shared ring; only the chunk header is the listener's own.
+ */
+typedef struct {
+    struct stream_relay *relay;
+    int fd;                     /* -1: slot free */
+    bool closing;
+    bool last_chunk;            /* the stream has ended: header holds the last chunk */
+    uint8_t skips;
+    uint8_t header_len;
+    char header[CHUNK_HEADER_MAX];
+    uint16_t chunk_len;         /* payload of the chunk in flight, 0 between chunks */
+    uint16_t chunk_sent;        /* of header, payload and trailer */
+    uint32_t pos;               /* stream position of the chunk payload */
+} relay_client_t;
+
+struct stream_relay {
+    httpd_handle_t server;
+    stream_relay_config_t config;
+    broadcast_ring_t ring;
+    TimerHandle_t retry;
+    atomic_bool work_queued;
+    atomic_bool finished;
+    atomic_uint clients;
+    atomic_uint_least64_t bytes_in;
+    atomic_uint_least64_t bytes_out;
+    stream_relay_stats_t stats; /* server task, except the byte counts */
+    uint8_t *storage;
+    relay_client_t slots[];
+};
+
+static void disconnect(stream_relay_t *relay, relay_client_t *client) {
+    client->closing = true;
+    httpd_sess_trigger_close(relay->server, client->fd);
+}
+
+/* For listeners too slow to keep up, as opposed to ones that went away. */
+static void drop(stream_relay_t *relay, relay_client_t *client) {
+    relay->stats.dropped++;
+    disconnect(relay, client);
+}
+
+/*
+ * Moves a lapped listener to the live edge; it hears a gap, and is dropped
+ * once that happens too often without it catching up in between. Mid-chunk
+ * the length is already on the wire, so the rest of the chunk comes from
+ * just behind the edge. Returns false when the listener was dropped.
+ */
+static bool skip(stream_relay_t *relay, relay_client_t *client) {
+    relay->stats.skips++;
+    if (++client->skips > relay->config.max_skips) {
+        drop(relay, client);
+        return false;
+    }
+    client->pos = broadcast_ring_head(&relay->ring) - client->chunk_len;
+    return true;
+}
+
+static void client_closed(void *ctx) {
+    relay_client_t *client = ctx;
+    stream_relay_t *relay = client->relay;
+    client->fd = -1;
+    client->closing = false;
+    atomic_fetch_sub(&relay->clients, 1);
+}
+
+/*
+ * Sends as much as the socket takes without blocking, chunk by chunk.
+ * Returns true when the socket filled up before the listener caught up,
+ * so it needs another pass; false once it is served or gone. Past the end
+ * of the stream, a caught-up listener gets the last chunk and is closed.
+ */
+static bool serve(stream_relay_t *relay, relay_client_t *client) {
+    broadcast_ring_t *ring = &relay->ring;
+    while (true) {
+        if (client->chunk_len == 0 && !client->last_chunk) {
+            if (!broadcast_ring_intact(ring, client->pos) && !skip(relay, client)) {
+                return false;
+            }
+            const uint8_t *data;
+            size_t len = broadcast_ring_peek(ring, client->pos, &data, relay->config.max_chunk);
+            if (len == 0) {
+                client->skips = 0;  /* caught up, so it is keeping pace again */
+                if (!atomic_load(&relay->finished)) {
+                    return false;
+                }
+                client->last_chunk = true;
+                client->chunk_sent = 0;
+                client->header_len = sizeof(LAST_CHUNK) - 1;
+                memcpy(client->header, LAST_CHUNK, client->header_len);
+                continue;
+            }
+            client->chunk_len = (uint16_t)len;
+            client->chunk_sent = 0;
+            client->header_len = (uint8_t)snprintf(client->header, sizeof(client->header), "%x\r\n",
+                                                   (unsigned)len);
+        }
+
+        size_t payload_end = client->header_len + client->chunk_len;
+        const char *buf;
+        size_t len;
+        bool payload = false;
+        if (client->chunk_sent < client->header_len) {
+            buf = client->header + client->chunk_sent;
+            len = client->header_len - client->chunk_sent;
+        } else if (client->chunk_sent < payload_end) {
+            if (!broadcast_ring_intact(ring, client->pos) && !skip(relay, client)) {
+                return false;
+            }
+            const uint8_t *data;
+            size_t offset = client->chunk_sent - client->header_len;
+            len = broadcast_ring_peek(ring, client->pos + offset, &data, client->chunk_len - offset);
+            buf = (const char *)data;
+            payload = true;
+        } else {
+            buf = CHUNK_TRAILER + (client->chunk_sent - payload_end);
+            len = payload_end + CHUNK_TRAILER_LEN - client->chunk_sent;
+        }
+
+        int sent = httpd_socket_send(relay->server, client->fd, buf, len, MSG_DONTWAIT);
+        if (sent == HTTPD_SOCK_ERR_TIMEOUT) {
+            return true;
+        }
+        if (sent < 0) {
+            disconnect(relay, client);
+            return false;
+        }
+        if (payload) {
+            atomic_fetch_add_explicit(&relay->bytes_out, sent, memory_order_relaxed);
+            /* Overwritten while it was being sent: what went out may be torn. */
+            if (!broadcast_ring_intact(ring, client->pos)) {
+                drop(relay, client);
+                return false;
+            }
+        }
+        client->chunk_sent += sent;
+        if (client->last_chunk) {
+            if (client->chunk_sent == client->header_len) {
+                disconnect(relay, client);
+                return false;
+            }
+        } else if (client->chunk_sent == payload_end + CHUNK_TRAILER_LEN) {
+            client->pos += client->chunk_len;
+            client->chunk_len = 0;
+        }
+    }
+}
+
+/* Runs in the server task, which owns the sockets, so a listener cannot close under us. */
+static void fan_out(void *arg) {
+    stream_relay_t *relay = arg;
+    atomic_store(&relay->work_queued, false);
+    bool behind = false;
+    for (int i = 0; i < relay->config.max_clients; i++) {
+        relay_client_t *client = &relay->slots[i];
+        if (client->fd >= 0 && !client->closing) {
+            behind |= serve(relay, client);
+        }
+    }
+    /* Writes normally bring the next pass; this one drains the ring when they pause or end. */
+    if (behind) {
+        xTimerReset(relay->retry, 0);
+    }
+}
+
+/*
+ * One queued pass serves every listener, however many writes or retries it
+ * covers. Stopping the server closes every listener first, so this never
+ * queues onto a server that is gone.
+ */
+static void queue_fan_out(stream_relay_t *relay) {
+    if (atomic_load(&relay->clients) > 0 && !atomic_exchange(&relay->work_queued, true) &&
+        httpd_queue_work(relay->server, fan_out, relay) != ESP_OK) {
+        atomic_store(&relay->work_queued, false);
+    }
+}
+
+static void retry_expired(TimerHandle_t timer) {
+    queue_fan_out(pvTimerGetTimerID(timer));
+}
+
+static esp_err_t stream_get_handler(httpd_req_t *req) {
+    stream_relay_t *relay = req->user_ctx;
+    relay_client_t *client = NULL;
+    for (int i = 0; i < relay->config.max_clients && client == NULL; i++) {
+        if (relay->slots[i].fd < 0) {
+            client = &relay->slots[i];
+        }
+    }
+    if (client == NULL) {
+        relay->stats.rejected++;
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Too many listeners\n", HTTPD_RESP_USE_STRLEN);
+    }
+    if (httpd_send(req, response_headers, sizeof(response_headers) - 1) < 0) {
+        return ESP_FAIL;
+    }
+
+    uint32_t head = broadcast_ring_head(&relay->ring);
+    uint32_t backlog = relay->ring.capacity / 2;
+    memset(client, 0, sizeof(*client));
+    client->relay = relay;
+    client->fd = httpd_req_to_sockfd(req);
+    client->pos = head - (head < backlog ? head : backlog);
+    /* The session keeps the slot; closing the connection frees it. */
+    req->sess_ctx = client;
+    req->free_ctx = client_closed;
+
+    unsigned clients = atomic_fetch_add(&relay->clients, 1) + 1;
+    relay->stats.accepted++;
+    if (clients > relay->stats.peak_clients) {
+        relay->stats.peak_clients = clients;
+    }
+    ESP_LOGI(TAG, "Listener on socket %d, %u connected", client->fd, clients);
+    if (serve(relay, client)) {
+        xTimerReset(relay->retry, 0);
+    }
+    return ESP_OK;
+}
+
+esp_err_t stream_relay_start(httpd_handle_t server, const stream_relay_config_t *config,
+                             stream_relay_handle_t *out) {
+    if (config->max_clients == 0 || config->max_chunk == 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    stream_relay_t *relay = calloc(1, sizeof(*relay) + config->max_clients * sizeof(relay_client_t));
+    if (relay == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    relay->storage = malloc(config->buffer_size);
+    relay->retry = xTimerCreate("relay_retry", pdMS_TO_TICKS(RETRY_MS), pdFALSE, relay, retry_expired);
+    esp_err_t err = relay->storage && relay->retry
+                        ? broadcast_ring_init(&relay->ring, relay->storage, config->buffer_size)
+                        : ESP_ERR_NO_MEM;
+    if (err != ESP_OK) {
+        if (relay->retry != NULL) {
+            xTimerDelete(relay->retry, portMAX_DELAY);
+        }
+        free(relay->storage);
+        free(relay);
+        return err;
+    }
+    relay->server = server;
+    relay->config = *config;
+    relay->stats.client_bytes = sizeof(relay_client_t);
+    for (int i = 0; i < config->max_clients; i++) {
+        relay->slots[i].fd = -1;
+    }
+
+    const httpd_uri_t uri = {
+        .uri = STREAM_RELAY_URI,
+        .method = HTTP_GET,
+        .handler = stream_get_handler,
+        .user_ctx = relay,
+    };
+    err = httpd_register_uri_handler(server, &uri);
+    if (err != ESP_OK) {
+        stream_relay_stop(relay);
+        return err;
+    }
+    *out = relay;
+    return ESP_OK;
+}
+
+void stream_relay_write(stream_relay_handle_t relay, const void *data, size_t len) {
+    broadcast_ring_write(&relay->ring, data, len);
+    atomic_fetch_add_explicit(&relay->bytes_in, len, memory_order_relaxed);
+    queue_fan_out(relay);
+}
+
+void stream_relay_finish(stream_relay_handle_t relay) {
+    atomic_store(&relay->finished, true);
+    queue_fan_out(relay);
+}
+
+void stream_relay_get_stats(stream_relay_handle_t relay, stream_relay_stats_t *stats) {
+    *stats = relay->stats;
+    stats->clients = atomic_load(&relay->clients);
+    stats->bytes_in = atomic_load_explicit(&relay->bytes_in, memory_order_relaxed);
+    stats->bytes_out = atomic_load_explicit(&relay->bytes_out, memory_order_relaxed);
+}
+
+static void timer_task_synced(void *done, uint32_t unused) {
+    xSemaphoreGive(done);
+}
+
+void stream_relay_stop(stream_relay_handle_t relay) {
+    xTimerDelete(relay->retry, portMAX_DELAY);
+    /* The timer task runs commands in order: once this call has run, so has any retry in flight. */
+    SemaphoreHandle_t done = xSemaphoreCreateBinary();
+    if (done != NULL) {
+        if (xTimerPendFunctionCall(timer_task_synced, done, 0, portMAX_DELAY) == pdPASS) {
+            xSemaphoreTake(done, portMAX_DELAY);
+        }
+        vSemaphoreDelete(done);
+    }
+    free(relay->storage);
+    free(relay);
+}
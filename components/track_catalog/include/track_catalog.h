@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACK_CATALOG_PATH_MAX 256
+#define TRACK_CATALOG_TEXT_MAX 128
+#define TRACK_CATALOG_MAX_DEPTH 4
+
+typedef struct {
+    char path[TRACK_CATALOG_PATH_MAX];
+    char title[TRACK_CATALOG_TEXT_MAX];     /* UTF-8; file name without extension if untagged */
+    char artist[TRACK_CATALOG_TEXT_MAX];
+    uint32_t duration_ms;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t audio_offset;                  /* first MPEG frame, past any ID3v2 tag */
+    uint16_t bitrate_kbps;                  /* average for VBR files with a Xing/VBRI header */
+} track_info_t;
+
+/*
+ * Catalog file: a header, one fixed 32-byte record per track in walk order
+ * (names sorted, '/' first), then the strings of every record in the same
+ * order. Opening
+ * reads the header only; pages of records are read on demand.
+ */
+typedef struct {
+    FILE *f;
+    uint32_t count;
+    uint32_t strings_offset;
+} track_catalog_t;
+
+typedef struct {
+    uint32_t tracks;
+    uint32_t unchanged;         /* size and mtime matched: copied from the old catalog */
+    uint32_t parsed;            /* new or modified: tags and headers read from the file */
+    uint32_t removed;
+} track_catalog_scan_stats_t;
+
+esp_err_t track_catalog_open(track_catalog_t *cat, const char *path);
+void track_catalog_close(track_catalog_t *cat);
+
+/*
+ * Reads up to max tracks starting at index first; *got is 0 past the end.
+ * ESP_ERR_INVALID_SIZE if a record's strings do not fit track_info_t.
+ */
+esp_err_t track_catalog_read(track_catalog_t *cat, uint32_t first, track_info_t *out, uint32_t max, uint32_t *got);
+
+/*
+ * Walks music_dir for *.mp3 and rewrites the catalog. Files whose size and
+ * mtime match the existing catalog are not opened. The new catalog is
+ * written next to the old one and swapped in when complete.
+ */
+esp_err_t track_catalog_rescan(const char *catalog_path, const char *music_dir, track_catalog_scan_stats_t *stats);
+
+/* Fills title, artist, duration, bitrate and audio offset from the file's ID3v2 tag and first frame. */
+esp_err_t track_catalog_probe(const char *path, uint32_t size, track_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,461 @@
+#include "track_catalog.h"
+
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include "esp_log.h"
+#include "track_probe.h"
+
+#define CATALOG_MAGIC 0x54414354u /* "TCAT" */
+/* 2: records in sorted walk order rather than readdir order. */
+#define CATALOG_VERSION 2
+#define PAGE_RECORDS 16
+#define NAMES_MIN_CAPACITY 32
+#define RECORD_TEXT_MAX (3 * UINT8_MAX)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t count;
+    uint32_t strings_offset;
+    uint32_t strings_bytes;
+    uint32_t reserved[3];
+} catalog_header_t;
+
+typedef struct {
+    uint32_t path_hash;
+    uint32_t size;
+    uint32_t mtime;
+    uint32_t duration_ms;
+    uint32_t audio_offset;
+    uint32_t strings;           /* offset of path, title, artist (unterminated) in the string block */
+    uint16_t bitrate_kbps;
+    uint8_t path_len;
+    uint8_t title_len;
+    uint8_t artist_len;
+    uint8_t reserved[3];
+} catalog_record_t;
+
+_Static_assert(sizeof(catalog_header_t) == 32, "catalog header layout");
+_Static_assert(sizeof(catalog_record_t) == 32, "catalog record layout");
+
+typedef struct {
+    char path[TRACK_CATALOG_PATH_MAX];
+    esp_err_t err;
+    FILE *old;
+    uint32_t old_count;
+    uint32_t old_strings;
+    uint32_t old_next;
+    bool have_old;              /* old_rec is the next old record not yet matched or passed */
+    catalog_record_t old_rec;
+    char old_text[RECORD_TEXT_MAX + 1];     /* its path, title and artist, path terminated */
+    FILE *records;
+    FILE *strings;
+    uint32_t count;
+    uint32_t strings_bytes;
+    track_catalog_scan_stats_t *stats;
+    track_info_t info;
+    uint8_t scratch[TRACK_PROBE_BYTES];
+} scan_t;
+
+static const char *TAG = "TRACK_CATALOG";
+
+static uint32_t hash_path(const char *path) {
+    /* FNV-1a */
+    uint32_t h = 2166136261u;
+    while (*path) {
+        h = (h ^ (uint8_t)*path++) * 16777619u;
+    }
+    return h;
+}
+
+static esp_err_t read_header(FILE *f, catalog_header_t *header) {
+    if (fseek(f, 0, SEEK_SET) != 0 || fread(header, sizeof(*header), 1, f) != 1) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (header->magic != CATALOG_MAGIC || header->version != CATALOG_VERSION ||
+        header->record_size != sizeof(catalog_record_t)) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+    /* A catalog cut short by a power loss is rebuilt rather than trusted. */
+    if (header->strings_offset != sizeof(*header) + header->count * sizeof(catalog_record_t) ||
+        fseek(f, 0, SEEK_END) != 0 || ftell(f) != (long)(header->strings_offset + header->strings_bytes)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t track_catalog_open(track_catalog_t *cat, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    catalog_header_t header;
+    esp_err_t err = read_header(f, &header);
+    if (err != ESP_OK) {
+        fclose(f);
+        return err;
+    }
+    cat->f = f;
+    cat->count = header.count;
+    cat->strings_offset = header.strings_offset;
+    return ESP_OK;
+}
+
+void track_catalog_close(track_catalog_t *cat) {
+    if (cat->f) {
+        fclose(cat->f);
+        cat->f = NULL;
+    }
+}
+
+/* Lengths come from the file: a damaged or foreign catalog must not overflow track_info_t. */
+static bool record_fits(const catalog_record_t *rec) {
+    return rec->path_len < TRACK_CATALOG_PATH_MAX && rec->title_len < TRACK_CATALOG_TEXT_MAX &&
+           rec->artist_len < TRACK_CATALOG_TEXT_MAX;
+}
+
+static bool read_string(FILE *f, char *out, size_t len) {
+    out[len] = '\0';
+    return fread(out, 1, len, f) == len;
+}
+
+esp_err_t track_catalog_read(track_catalog_t *cat, uint32_t first, track_info_t *out, uint32_t max, uint32_t *got) {
+    *got = 0;
+    if (first >= cat->count) {
+        return ESP_OK;
+    }
+    uint32_t n = cat->count - first < max ? cat->count - first : max;
+    catalog_record_t page[PAGE_RECORDS];
+    for (uint32_t done = 0; done < n;) {
+        uint32_t chunk = n - done < PAGE_RECORDS ? n - done : PAGE_RECORDS;
+        if (fseek(cat->f, sizeof(catalog_header_t) + (first + done) * sizeof(catalog_record_t), SEEK_SET) != 0 ||
+            fread(page, sizeof(catalog_record_t), chunk, cat->f) != chunk) {
+            return ESP_FAIL;
+        }
+        /* The strings of consecutive records are contiguous: one seek per page. */
+        if (fseek(cat->f, cat->strings_offset + page[0].strings, SEEK_SET) != 0) {
+            return ESP_FAIL;
+        }
+        for (uint32_t i = 0; i < chunk; i++) {
+            const catalog_record_t *rec = &page[i];
+            track_info_t *info = &out[done + i];
+            if (!record_fits(rec)) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            if (!read_string(cat->f, info->path, rec->path_len) || !read_string(cat->f, info->title, rec->title_len) ||
+                !read_string(cat->f, info->artist, rec->artist_len)) {
+                return ESP_FAIL;
+            }
+            info->duration_ms = rec->duration_ms;
+            info->size = rec->size;
+            info->mtime = rec->mtime;
+            info->audio_offset = rec->audio_offset;
+            info->bitrate_kbps = rec->bitrate_kbps;
+        }
+        done += chunk;
+    }
+    *got = n;
+    return ESP_OK;
+}
+
+/*
+ * Walk order: names sorted bytewise with '/' before any other byte, so a
+ * directory's contents come right after its name. Comparing whole paths
+ * this way gives the order of a depth-first walk over sorted entries, and
+ * sorts a flat SPIFFS listing ("dir/file.mp3") the same way.
+ */
+static int walk_order(const char *a, const char *b) {
+    while (*a != '\0' && *a == *b) {
+        a++;
+        b++;
+    }
+    int ca = *a == '/' ? 1 : (uint8_t)*a;
+    int cb = *b == '/' ? 1 : (uint8_t)*b;
+    return ca - cb;
+}
+
+static void next_old(scan_t *scan) {
+    scan->have_old = false;
+    if (scan->old == NULL || scan->old_next >= scan->old_count) {
+        return;
+    }
+    catalog_record_t *rec = &scan->old_rec;
+    if (fseek(scan->old, sizeof(catalog_header_t) + scan->old_next * sizeof(catalog_record_t), SEEK_SET) != 0 ||
+        fread(rec, sizeof(*rec), 1, scan->old) != 1) {
+        /* Treat the rest of an unreadable catalog as gone; those files are parsed again. */
+        scan->old_next = scan->old_count;
+        return;
+    }
+    scan->old_next++;
+    size_t len = rec->path_len + rec->title_len + rec->artist_len;
+    if (fseek(scan->old, scan->old_strings + rec->strings, SEEK_SET) != 0 ||
+        fread(scan->old_text, 1, len, scan->old) != len) {
+        scan->old_next = scan->old_count;
+        return;
+    }
+    /* Only for walk_order(); the title follows it when the record is copied. */
+    scan->old_text[len] = '\0';
+    scan->have_old = true;
+}
+
+/*
+ * Both catalogs are in walk order, so this is a merge: old records that
+ * sort before path were deleted. On a match the old strings are left in
+ * scratch.
+ */
+static bool take_old(scan_t *scan, catalog_record_t *out) {
+    while (scan->have_old) {
+        char saved = scan->old_text[scan->old_rec.path_len];
+        scan->old_text[scan->old_rec.path_len] = '\0';
+        int order = walk_order(scan->old_text, scan->path);
+        scan->old_text[scan->old_rec.path_len] = saved;
+        if (order > 0) {
+            return false;
+        }
+        if (order == 0 && !record_fits(&scan->old_rec)) {
+            /* Not trusted: the file is parsed again. */
+            next_old(scan);
+            return false;
+        }
+        if (order == 0) {
+            *out = scan->old_rec;
+            memcpy(scan->scratch, scan->old_text, out->path_len + out->title_len + out->artist_len);
+            next_old(scan);
+            return true;
+        }
+        scan->stats->removed++;
+        next_old(scan);
+    }
+    return false;
+}
+
+static void write_track(scan_t *scan, catalog_record_t *rec, const void *strings) {
+    size_t len = rec->path_len + rec->title_len + rec->artist_len;
+    rec->strings = scan->strings_bytes;
+    if (fwrite(rec, sizeof(*rec), 1, scan->records) != 1 || fwrite(strings, 1, len, scan->strings) != len) {
+        scan->err = ESP_FAIL;
+        return;
+    }
+    scan->count++;
+    scan->strings_bytes += len;
+}
+
+static void add_track(scan_t *scan, const struct stat *st) {
+    size_t path_len = strlen(scan->path);
+    catalog_record_t rec;
+    if (take_old(scan, &rec) && rec.size == (uint32_t)st->st_size &&
+        rec.mtime == (uint32_t)st->st_mtime) {
+        scan->stats->unchanged++;
+        write_track(scan, &rec, scan->scratch);
+        return;
+    }
+
+    track_info_t *info = &scan->info;
+    if (track_probe(scan->path, st->st_size, info, scan->scratch) != ESP_OK) {
+        ESP_LOGW(TAG, "Skipping %s: no MPEG audio found", scan->path);
+        return;
+    }
+    scan->stats->parsed++;
+    size_t title_len = strlen(info->title);
+    size_t artist_len = strlen(info->artist);
+    rec = (catalog_record_t) {
+        .path_hash = hash_path(scan->path),
+        .size = st->st_size,
+        .mtime = st->st_mtime,
+        .duration_ms = info->duration_ms,
+        .audio_offset = info->audio_offset,
+        .bitrate_kbps = info->bitrate_kbps,
+        .path_len = path_len,
+        .title_len = title_len,
+        .artist_len = artist_len,
+    };
+    /* Lay the strings out back to back in scratch, as they are stored. */
+    memcpy(scan->scratch, scan->path, path_len);
+    memcpy(scan->scratch + path_len, info->title, title_len);
+    memcpy(scan->scratch + path_len + title_len, info->artist, artist_len);
+    write_track(scan, &rec, scan->scratch);
+}
+
+static bool is_mp3(const char *name, size_t len) {
+    return len > 4 && strcasecmp(name + len - 4, ".mp3") == 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return walk_order(*(char *const *)a, *(char *const *)b);
+}
+
+static void free_names(char **names, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+/* readdir() order differs between file systems; sort so both catalogs agree. */
+static esp_err_t read_names(DIR *dir, char ***out, size_t *out_count) {
+    char **names = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (count == capacity) {
+            size_t grown = capacity ? capacity * 2 : NAMES_MIN_CAPACITY;
+            char **bigger = realloc(names, grown * sizeof(*names));
+            if (bigger == NULL) {
+                free_names(names, count);
+                return ESP_ERR_NO_MEM;
+            }
+            names = bigger;
+            capacity = grown;
+        }
+        names[count] = strdup(entry->d_name);
+        if (names[count] == NULL) {
+            free_names(names, count);
+            return ESP_ERR_NO_MEM;
+        }
+        count++;
+    }
+    if (count > 1) {
+        qsort(names, count, sizeof(*names), compare_names);
+    }
+    *out = names;
+    *out_count = count;
+    return ESP_OK;
+}
+
+static void walk(scan_t *scan, size_t len, int depth) {
+    DIR *dir = opendir(scan->path);
+    if (dir == NULL) {
+        if (depth == 0) {
+            scan->err = ESP_ERR_NOT_FOUND;
+        }
+        return;
+    }
+    char **names;
+    size_t count;
+    scan->err = read_names(dir, &names, &count);
+    closedir(dir);
+    if (scan->err != ESP_OK) {
+        return;
+    }
+    for (size_t i = 0; i < count && scan->err == ESP_OK; i++) {
+        size_t n = strlen(names[i]);
+        if (len + 1 + n >= sizeof(scan->path)) {
+            continue;
+        }
+        scan->path[len] = '/';
+        memcpy(scan->path + len + 1, names[i], n + 1);
+        struct stat st;
+        if (stat(scan->path, &st) != 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (depth < TRACK_CATALOG_MAX_DEPTH) {
+                walk(scan, len + 1 + n, depth + 1);
+            }
+        } else if (is_mp3(names[i], n)) {
+            add_track(scan, &st);
+        }
+    }
+    scan->path[len] = '\0';
+    free_names(names, count);
+}
+
+static esp_err_t finish(scan_t *scan) {
+    catalog_header_t header = {
+        .magic = CATALOG_MAGIC,
+        .version = CATALOG_VERSION,
+        .record_size = sizeof(catalog_record_t),
+        .count = scan->count,
+        .strings_offset = sizeof(catalog_header_t) + scan->count * sizeof(catalog_record_t),
+        .strings_bytes = scan->strings_bytes,
+    };
+    if (fseek(scan->strings, 0, SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    size_t n;
+    while ((n = fread(scan->scratch, 1, sizeof(scan->scratch), scan->strings)) > 0) {
+        if (fwrite(scan->scratch, 1, n, scan->records) != n) {
+            return ESP_FAIL;
+        }
+    }
+    if (fseek(scan->records, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, scan->records) != 1) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t track_catalog_rescan(const char *catalog_path, const char *music_dir, track_catalog_scan_stats_t *stats) {
+    size_t dir_len = strlen(music_dir);
+    if (dir_len >= TRACK_CATALOG_PATH_MAX || strlen(catalog_path) + 4 >= TRACK_CATALOG_PATH_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    scan_t *scan = calloc(1, sizeof(*scan));
+    if (scan == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memset(stats, 0, sizeof(*stats));
+    scan->stats = stats;
+
+    scan->old = fopen(catalog_path, "rb");
+    catalog_header_t old_header;
+    if (scan->old && read_header(scan->old, &old_header) == ESP_OK) {
+        scan->old_count = old_header.count;
+        scan->old_strings = old_header.strings_offset;
+    } else if (scan->old) {
+        ESP_LOGW(TAG, "%s is damaged or outdated, rebuilding", catalog_path);
+        fclose(scan->old);
+        scan->old = NULL;
+    }
+
+    char tmp_path[TRACK_CATALOG_PATH_MAX];
+    char str_path[TRACK_CATALOG_PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", catalog_path);
+    snprintf(str_path, sizeof(str_path), "%s.str", catalog_path);
+    scan->records = fopen(tmp_path, "wb");
+    scan->strings = fopen(str_path, "w+b");
+    catalog_header_t placeholder = { 0 };
+    if (scan->records == NULL || scan->strings == NULL ||
+        fwrite(&placeholder, sizeof(placeholder), 1, scan->records) != 1) {
+        scan->err = ESP_FAIL;
+    }
+
+    next_old(scan);
+    if (scan->err == ESP_OK) {
+        memcpy(scan->path, music_dir, dir_len + 1);
+        walk(scan, dir_len, 0);
+    }
+    stats->removed += (scan->have_old ? 1 : 0) + (scan->old_count - scan->old_next);
+    stats->tracks = scan->count;
+    if (scan->err == ESP_OK) {
+        scan->err = finish(scan);
+    }
+
+    if (scan->old) {
+        fclose(scan->old);
+    }
+    if (scan->strings) {
+        fclose(scan->strings);
+    }
+    remove(str_path);
+    if (scan->records && fclose(scan->records) != 0 && scan->err == ESP_OK) {
+        scan->err = ESP_FAIL;
+    }
+    esp_err_t err = scan->err;
+    free(scan);
+    if (err != ESP_OK) {
+        remove(tmp_path);
+        return err;
+    }
+    /* rename() will not replace an existing file on SPIFFS or FAT. */
+    remove(catalog_path);
+    return rename(tmp_path, catalog_path) == 0 ? ESP_OK : ESP_FAIL;
+}
@@ -0,0 +1,229 @@
+#include "track_probe.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mp3_frame.h"
+
+static uint32_t read_be32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t read_syncsafe(const uint8_t *p) {
+    return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+/* Appends one code point, keeping room for the terminator and never splitting a sequence. */
+static bool put_utf8(char *out, size_t size, size_t *len, uint32_t cp) {
+    uint8_t buf[4];
+    size_t n;
+    if (cp < 0x80) {
+        buf[0] = cp;
+        n = 1;
+    } else if (cp < 0x800) {
+        buf[0] = 0xC0 | (cp >> 6);
+        buf[1] = 0x80 | (cp & 0x3F);
+        n = 2;
+    } else if (cp < 0x10000) {
+        buf[0] = 0xE0 | (cp >> 12);
+        buf[1] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[2] = 0x80 | (cp & 0x3F);
+        n = 3;
+    } else {
+        buf[0] = 0xF0 | (cp >> 18);
+        buf[1] = 0x80 | ((cp >> 12) & 0x3F);
+        buf[2] = 0x80 | ((cp >> 6) & 0x3F);
+        buf[3] = 0x80 | (cp & 0x3F);
+        n = 4;
+    }
+    if (*len + n >= size) {
+        return false;
+    }
+    memcpy(out + *len, buf, n);
+    *len += n;
+    return true;
+}
+
+/* ID3v2 text frame body (encoding byte + text) to UTF-8. */
+static void id3_text(const uint8_t *data, size_t len, char *out, size_t size) {
+    size_t n = 0;
+    if (len > 0) {
+        uint8_t encoding = data[0];
+        const uint8_t *p = data + 1;
+        const uint8_t *end = data + len;
+        if (encoding == 1 || encoding == 2) {
+            bool big_endian = encoding == 2;
+            if (encoding == 1 && end - p >= 2) {
+                big_endian = p[0] == 0xFE && p[1] == 0xFF;
+                if ((p[0] == 0xFE && p[1] == 0xFF) || (p[0] == 0xFF && p[1] == 0xFE)) {
+                    p += 2;
+                }
+            }
+            while (end - p >= 2) {
+                uint32_t cp = big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+                p += 2;
+                if (cp == 0) {
+                    break;
+                }
+                if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 2) {
+                    uint32_t low = big_endian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+                    if (low >= 0xDC00 && low < 0xE000) {
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        p += 2;
+                    }
+                }
+                if (cp >= 0xD800 && cp < 0xE000) {
+                    cp = '?';
+                }
+                if (!put_utf8(out, size, &n, cp)) {
+                    break;
+                }
+            }
+        } else {
+            while (p < end && *p != 0) {
+                if (encoding == 3) {
+                    /* Already UTF-8: copy whole sequences only. */
+                    size_t seq = *p < 0x80 ? 1 : *p >= 0xF0 ? 4 : *p >= 0xE0 ? 3 : 2;
+                    if (seq > (size_t)(end - p) || n + seq >= size) {
+                        break;
+                    }
+                    memcpy(out + n, p, seq);
+                    n += seq;
+                    p += seq;
+                } else if (!put_utf8(out, size, &n, *p++)) {
+                    break;
+                }
+            }
+        }
+    }
+    /* Tags often pad with spaces. */
+    while (n > 0 && out[n - 1] == ' ') {
+        n--;
+    }
+    out[n] = '\0';
+}
+
+static void parse_id3(const uint8_t *tag, size_t len, track_info_t *info) {
+    uint8_t version = tag[3];
+    if (version < 2 || version > 4) {
+        return;
+    }
+    size_t header = version == 2 ? 6 : 10;
+    size_t pos = 10;
+    if (version >= 3 && (tag[5] & 0x40) && len >= 14) {
+        pos += version == 3 ? read_be32(tag + 10) + 4 : read_syncsafe(tag + 10);
+    }
+    while (pos + header <= len) {
+        const uint8_t *frame = tag + pos;
+        if (frame[0] == 0) {
+            break;
+        }
+        size_t size;
+        if (version == 2) {
+            size = ((size_t)frame[3] << 16) | ((size_t)frame[4] << 8) | frame[5];
+        } else if (version == 3) {
+            size = read_be32(frame + 4);
+        } else {
+            size = read_syncsafe(frame + 4);
+        }
+        if (size > len - pos - header) {
+            break;
+        }
+        const uint8_t *body = frame + header;
+        if (version == 2 ? memcmp(frame, "TT2", 3) == 0 : memcmp(frame, "TIT2", 4) == 0) {
+            id3_text(body, size, info->title, sizeof(info->title));
+        } else if (version == 2 ? memcmp(frame, "TP1", 3) == 0 : memcmp(frame, "TPE1", 4) == 0) {
+            id3_text(body, size, info->artist, sizeof(info->artist));
+        }
+        pos += header + size;
+    }
+}
+
+static void title_from_path(const char *path, char *out, size_t size) {
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char *dot = strrchr(name, '.');
+    size_t n = dot && dot != name ? (size_t)(dot - name) : strlen(name);
+    if (n >= size) {
+        n = size - 1;
+        /* Back off to a UTF-8 boundary. */
+        while (n > 0 && ((uint8_t)name[n] & 0xC0) == 0x80) {
+            n--;
+        }
+    }
+    memcpy(out, name, n);
+    out[n] = '\0';
+}
+
+esp_err_t track_probe(const char *path, uint32_t size, track_info_t *info, uint8_t *buf) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    info->title[0] = '\0';
+    info->artist[0] = '\0';
+    info->duration_ms = 0;
+    info->bitrate_kbps = 0;
+    info->audio_offset = 0;
+
+    size_t n = fread(buf, 1, TRACK_PROBE_BYTES, f);
+    size_t tag_size = mp3_id3v2_size(buf, n);
+    if (tag_size > 0) {
+        parse_id3(buf, tag_size < n ? tag_size : n, info);
+    }
+
+    uint32_t offset = tag_size;
+    if (offset > 0) {
+        if (fseek(f, offset, SEEK_SET) != 0) {
+            fclose(f);
+            return ESP_FAIL;
+        }
+        n = fread(buf, 1, TRACK_PROBE_BYTES, f);
+    }
+    fclose(f);
+
+    /* First header followed by a compatible one; padding or junk before it is skipped. */
+    mp3_frame_header_t header, next;
+    size_t pos = 0;
+    bool found = false;
+    for (; pos + MP3_FRAME_HEADER_BYTES <= n; pos++) {
+        if (!mp3_frame_parse(buf + pos, &header)) {
+            continue;
+        }
+        size_t after = pos + header.frame_bytes;
+        if (after + MP3_FRAME_HEADER_BYTES > n ||
+            (mp3_frame_parse(buf + after, &next) && mp3_frame_compatible(&header, &next))) {
+            found = true;
+            break;
+        }
+    }
+
+    if (info->title[0] == '\0') {
+        title_from_path(path, info->title, sizeof(info->title));
+    }
+    if (!found) {
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    info->audio_offset = offset + pos;
+
+    uint32_t audio_bytes = size > info->audio_offset ? size - info->audio_offset : 0;
+    uint32_t frames;
+    if (mp3_vbr_frame_count(buf + pos, n - pos, &header, &frames) && frames > 0) {
+        info->duration_ms = (uint32_t)((uint64_t)frames * header.samples * 1000 / header.sample_rate);
+        info->bitrate_kbps = info->duration_ms ? (uint64_t)audio_bytes * 8 / info->duration_ms : header.bitrate_kbps;
+    } else {
+        info->bitrate_kbps = header.bitrate_kbps;
+        info->duration_ms = (uint64_t)audio_bytes * 8 / header.bitrate_kbps;
+    }
+    return ESP_OK;
+}
+
+esp_err_t track_catalog_probe(const char *path, uint32_t size, track_info_t *info) {
+    uint8_t *buf = malloc(TRACK_PROBE_BYTES);
+    if (buf == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    esp_err_t err = track_probe(path, size, info, buf);
+    free(buf);
+    return err;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "track_catalog.h"
+
+/* Enough for the text frames of a typical tag and for finding the first frame after it. */
+#define TRACK_PROBE_BYTES 4096
+
+/* track_catalog_probe() with a caller-owned TRACK_PROBE_BYTES scratch buffer. */
+esp_err_t track_probe(const char *path, uint32_t size, track_info_t *info, uint8_t *buf);
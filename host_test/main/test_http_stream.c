@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "jitter_buffer.h"
+#include "http_stream.h"
+
+/* Served by the fixture in pytest_host_test.py; keep the values in sync. */
+#define STREAM_TEST_URL "http://127.0.0.1:8070/stream.bin"
+#define STREAM_DROP_TEST_URL "http://127.0.0.1:8070/drop.bin"
+#define STREAM_TEST_SIZE (4 * 1024 * 1024)
+#define STREAM_TEST_DEADLINE_US (30 * 1000 * 1000)
+
+static uint8_t pattern_byte(uint64_t i) {
+    return (uint8_t)(i * 7 + (i >> 10));
+}
+
+static size_t produce(jitter_buffer_t *jb, size_t len, uint8_t value) {
+    size_t done = 0;
+    while (done < len) {
+        uint8_t *span;
+        size_t n = jitter_buffer_write_span(jb, &span);
+        if (n == 0) {
+            break;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+        memset(span, value, n);
+        jitter_buffer_commit(jb, n);
+        done += n;
+    }
+    return done;
+}
+
+TEST_CASE("jitter buffer holds reads until the low watermark", "[http_stream]") {
+    static uint8_t storage[1000];
+    uint8_t out[1000];
+    jitter_buffer_t jb;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, jitter_buffer_init(&jb, storage, sizeof(storage), 900, 800));
+    TEST_ASSERT_EQUAL(ESP_OK, jitter_buffer_init(&jb, storage, sizeof(storage), 300, 800));
+
+    TEST_ASSERT_EQUAL(299, produce(&jb, 299, 1));
+    TEST_ASSERT_EQUAL(0, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(0, jb.underruns);
+    TEST_ASSERT_EQUAL(1, produce(&jb, 1, 2));
+    TEST_ASSERT_EQUAL(300, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(2, out[299]);
+}
+
+TEST_CASE("jitter buffer pauses the producer at the high watermark", "[http_stream]") {
+    static uint8_t storage[1000];
+    uint8_t out[1000];
+    jitter_buffer_t jb;
+    TEST_ASSERT_EQUAL(ESP_OK, jitter_buffer_init(&jb, storage, sizeof(storage), 100, 800));
+
+    TEST_ASSERT_EQUAL(700, produce(&jb, 700, 3));
+    uint8_t *span;
+    TEST_ASSERT_EQUAL(300, jitter_buffer_write_span(&jb, &span));
+    /* A read may overshoot the watermark; the next one waits. */
+    TEST_ASSERT_EQUAL(200, produce(&jb, 200, 3));
+    TEST_ASSERT_EQUAL(0, jitter_buffer_write_span(&jb, &span));
+
+    TEST_ASSERT_EQUAL(700, jitter_buffer_read(&jb, out, 700));
+    /* Free space is split by the wrap: first the tail end, then the front. */
+    TEST_ASSERT_EQUAL(100, jitter_buffer_write_span(&jb, &span));
+    TEST_ASSERT_EQUAL(800, produce(&jb, 2000, 4));
+    TEST_ASSERT_EQUAL(1000, jb.fill);
+    TEST_ASSERT_EQUAL(1000, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(3, out[199]);
+    TEST_ASSERT_EQUAL(4, out[200]);
+    TEST_ASSERT_EQUAL(4, out[999]);
+}
+
+TEST_CASE("jitter buffer counts an underrun and rebuffers", "[http_stream]") {
+    static uint8_t storage[256];
+    uint8_t out[256];
+    jitter_buffer_t jb;
+    TEST_ASSERT_EQUAL(ESP_OK, jitter_buffer_init(&jb, storage, sizeof(storage), 64, 200));
+
+    produce(&jb, 64, 5);
+    TEST_ASSERT_EQUAL(64, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(0, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(1, jb.underruns);
+    produce(&jb, 10, 6);
+    TEST_ASSERT_EQUAL(0, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(1, jb.underruns);
+
+    /* At end of stream the tail drains below the watermark and no underrun is counted. */
+    jitter_buffer_set_eof(&jb);
+    TEST_ASSERT_EQUAL(10, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_EQUAL(0, jitter_buffer_read(&jb, out, sizeof(out)));
+    TEST_ASSERT_TRUE(jitter_buffer_drained(&jb));
+    TEST_ASSERT_EQUAL(1, jb.underruns);
+}
+
+TEST_CASE("stream resumes with Range after a dropped connection", "[http_stream]") {
+    static uint8_t buf[4096];
+    http_stream_config_t config = HTTP_STREAM_DEFAULT_CONFIG();
+    config.url = STREAM_DROP_TEST_URL;
+    config.retry_min_ms = 50;
+    http_stream_handle_t stream;
+    TEST_ASSERT_EQUAL(ESP_OK, http_stream_start(&config, &stream));
+
+    uint64_t total = 0;
+    uint64_t mismatches = 0;
+    int64_t start = esp_timer_get_time();
+    while (esp_timer_get_time() - start < STREAM_TEST_DEADLINE_US) {
+        int n = http_stream_read(stream, buf, sizeof(buf), pdMS_TO_TICKS(1000));
+        if (n < 0) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (buf[i] != pattern_byte(total + i)) {
+                mismatches++;
+            }
+        }
+        total += n;
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+
+    http_stream_stats_t stats;
+    http_stream_get_stats(stream, &stats);
+    http_stream_stop(stream);
+
+    printf("http_stream %llu bytes in %lld ms: %.2f MB/s sustained\n", (unsigned long long)total,
+           (long long)(elapsed_us / 1000), total / (double)elapsed_us);
+    printf("http_stream reconnects %u, recovery last %u ms max %u ms, underruns %u\n",
+           (unsigned)stats.reconnects, (unsigned)stats.last_recovery_ms, (unsigned)stats.max_recovery_ms,
+           (unsigned)stats.underruns);
+
+    TEST_ASSERT_EQUAL(STREAM_TEST_SIZE, total);
+    TEST_ASSERT_EQUAL(0, mismatches);
+    TEST_ASSERT_EQUAL(STREAM_TEST_SIZE, stats.content_length);
+    TEST_ASSERT_GREATER_OR_EQUAL(1, stats.reconnects);
+}
+
+static uint64_t read_checked(http_stream_handle_t stream, uint64_t pos, uint64_t len, uint64_t *mismatches) {
+    static uint8_t buf[4096];
+    uint64_t total = 0;
+    while (total < len) {
+        int n = http_stream_read(stream, buf, len - total < sizeof(buf) ? len - total : sizeof(buf), pdMS_TO_TICKS(5000));
+        if (n <= 0) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (buf[i] != pattern_byte(pos + total + i)) {
+                (*mismatches)++;
+            }
+        }
+        total += n;
+    }
+    return total;
+}
+
+TEST_CASE("stream seeks with a Range request", "[http_stream]") {
+    http_stream_config_t config = HTTP_STREAM_DEFAULT_CONFIG();
+    config.url = STREAM_TEST_URL;
+    http_stream_handle_t stream;
+    TEST_ASSERT_EQUAL(ESP_OK, http_stream_start(&config, &stream));
+    uint64_t mismatches = 0;
+    TEST_ASSERT_EQUAL(65536, read_checked(stream, 0, 65536, &mismatches));
+
+    const uint64_t far = 3 * 1024 * 1024 + 123;
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(ESP_OK, http_stream_seek(stream, far));
+    TEST_ASSERT_EQUAL(4096, read_checked(stream, far, 4096, &mismatches));
+    int64_t seek_us = esp_timer_get_time() - start;
+    TEST_ASSERT_EQUAL(STREAM_TEST_SIZE - far - 4096, read_checked(stream, far + 4096, UINT64_MAX, &mismatches));
+    uint8_t byte;
+    TEST_ASSERT_EQUAL(-1, http_stream_read(stream, &byte, 1, pdMS_TO_TICKS(1000)));
+
+    /* Back to the start after the end of the resource. */
+    TEST_ASSERT_EQUAL(ESP_OK, http_stream_seek(stream, 1000));
+    TEST_ASSERT_EQUAL(4096, read_checked(stream, 1000, 4096, &mismatches));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, http_stream_seek(stream, STREAM_TEST_SIZE + 1));
+
+    http_stream_stats_t stats;
+    http_stream_get_stats(stream, &stats);
+    http_stream_stop(stream);
+    printf("http_stream seek to %llu: first data after %lld ms\n", (unsigned long long)far, (long long)(seek_us / 1000));
+    TEST_ASSERT_EQUAL(0, mismatches);
+    TEST_ASSERT_EQUAL(0, stats.reconnects);
+}
@@ -0,0 +1,7 @@
+#include "unity.h"
+
+void app_main(void) {
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    UNITY_END();
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_http_client.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "metrics_http.h"
+
+#define METRICS_TEST_PORT 8071
+#define METRICS_TEST_URL "http://127.0.0.1:8071" METRICS_HTTP_URI
+#define METRICS_BENCH_OPS (1000 * 1000)
+/* Per-call budgets, loose enough for a loaded host; a counter is one relaxed atomic add. */
+#define COUNTER_BUDGET_NS 1000
+#define HISTOGRAM_BUDGET_NS 2000
+
+static char body[16384];
+
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} string_writer_t;
+
+static void write_string(void *ctx, const char *data, size_t len) {
+    string_writer_t *w = ctx;
+    if (w->len + len < w->size) {
+        memcpy(w->buf + w->len, data, len);
+        w->len += len;
+        w->buf[w->len] = '\0';
+    }
+}
+
+static void render(metrics_format_t format) {
+    string_writer_t w = { .buf = body, .size = sizeof(body) };
+    body[0] = '\0';
+    metrics_render(format, write_string, &w);
+}
+
+static int scrape(const char *url) {
+    esp_http_client_config_t config = { .url = url };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    TEST_ASSERT_NOT_NULL(client);
+    int total = -1;
+    if (esp_http_client_open(client, 0) == ESP_OK && esp_http_client_fetch_headers(client) >= 0 &&
+        esp_http_client_get_status_code(client) == 200) {
+        int n;
+        total = 0;
+        while (total < (int)sizeof(body) - 1 && (n = esp_http_client_read(client, body + total, sizeof(body) - 1 - total)) > 0) {
+            total += n;
+        }
+        body[total] = '\0';
+    }
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return total;
+}
+
+static int64_t fixed_gauge(void *ctx) {
+    return *(int *)ctx;
+}
+
+static int64_t other_gauge(void *ctx) {
+    return -1;
+}
+
+static int count_lines(const char *prefix) {
+    int n = 0;
+    for (const char *p = strstr(body, prefix); p != NULL; p = strstr(p + 1, prefix)) {
+        n++;
+    }
+    return n;
+}
+
+TEST_CASE("metrics render counters, gauges and histograms", "[metrics]") {
+    static int level = 42;
+    metrics_counter_t *events = metrics_counter_register("test_events");
+    TEST_ASSERT_NOT_NULL(events);
+    TEST_ASSERT_TRUE(events == metrics_counter_register("test_events"));
+    metrics_histogram_t *latency = metrics_histogram_register("test_latency_us");
+    TEST_ASSERT_NOT_NULL(latency);
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_gauge_register("test_level", fixed_gauge, &level));
+    /* A second registration keeps the first. */
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_gauge_register("test_level", other_gauge, NULL));
+    /* What a failed registration hands out. */
+    metrics_counter_add(NULL, 1);
+    metrics_histogram_record(NULL, 1);
+
+    metrics_counter_add(events, 2);
+    metrics_counter_add(events, 1);
+    metrics_histogram_record(latency, 10);
+    metrics_histogram_record(latency, 17);
+    metrics_histogram_record(latency, 32);
+    metrics_histogram_record(latency, 5 * 1000 * 1000);
+
+    render(METRICS_FORMAT_TEXT);
+    TEST_ASSERT_NOT_NULL(strstr(body, "\ntest_events 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "\ntest_level 42\n"));
+    TEST_ASSERT_EQUAL(1, count_lines("\ntest_level "));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_bucket{le=\"16\"} 1\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_bucket{le=\"32\"} 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_bucket{le=\"262144\"} 3\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_bucket{le=\"+Inf\"} 4\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_count 4\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_sum 5000059\n"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "test_latency_us_max 5000000\n"));
+
+    render(METRICS_FORMAT_JSON);
+    TEST_ASSERT_EQUAL('{', body[0]);
+    TEST_ASSERT_NOT_NULL(strstr(body, "\"test_events\":3"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "\"test_level\":42"));
+    TEST_ASSERT_NOT_NULL(strstr(body, "\"test_latency_us\":{\"count\":4,\"sum_us\":5000059,\"max_us\":5000000,"
+                                      "\"buckets\":[1,2,0,0,0,0,0,0,0,0,0,0,0,0,0,1]}"));
+    int depth = 0;
+    for (const char *p = body; *p; p++) {
+        depth += (*p == '{') - (*p == '}');
+        TEST_ASSERT_GREATER_OR_EQUAL(0, depth);
+    }
+    TEST_ASSERT_EQUAL(0, depth);
+}
+
+TEST_CASE("metrics endpoint serves text and JSON", "[metrics]") {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = METRICS_TEST_PORT;
+    config.ctrl_port = METRICS_TEST_PORT + 1;
+    httpd_handle_t server;
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_start(&server, &config));
+    TEST_ASSERT_EQUAL(ESP_OK, metrics_http_register(server));
+    metrics_counter_t *scrapes = metrics_counter_register("test_scrapes");
+
+    metrics_counter_add(scrapes, 1);
+    int64_t start = esp_timer_get_time();
+    int len = scrape(METRICS_TEST_URL);
+    int64_t text_us = esp_timer_get_time() - start;
+    TEST_ASSERT_GREATER_THAN(0, len);
+    TEST_ASSERT_NOT_NULL(strstr(body, "uptime_us "));
+    TEST_ASSERT_NOT_NULL(strstr(body, "\ntest_scrapes 1\n"));
+
+    metrics_counter_add(scrapes, 1);
+    start = esp_timer_get_time();
+    int json_len = scrape(METRICS_TEST_URL "?format=json");
+    int64_t json_us = esp_timer_get_time() - start;
+    TEST_ASSERT_GREATER_THAN(0, json_len);
+    TEST_ASSERT_EQUAL('{', body[0]);
+    TEST_ASSERT_NOT_NULL(strstr(body, "\"test_scrapes\":2"));
+
+    httpd_stop(server);
+    printf("metrics scrape: text %d bytes in %lld us, json %d bytes in %lld us\n", len, (long long)text_us, json_len,
+           (long long)json_us);
+}
+
+TEST_CASE("metrics recording stays within its overhead budget", "[metrics]") {
+    metrics_counter_t *counter = metrics_counter_register("test_bench_ops");
+    metrics_histogram_t *hist = metrics_histogram_register("test_bench_us");
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < METRICS_BENCH_OPS; i++) {
+        metrics_counter_add(counter, 1);
+    }
+    int64_t counter_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (int i = 0; i < METRICS_BENCH_OPS; i++) {
+        metrics_histogram_record(hist, i & 0xFFFF);
+    }
+    int64_t hist_us = esp_timer_get_time() - start;
+
+    double counter_ns = counter_us * 1000.0 / METRICS_BENCH_OPS;
+    double hist_ns = hist_us * 1000.0 / METRICS_BENCH_OPS;
+    printf("metrics overhead: counter %.1f ns, histogram %.1f ns per call\n", counter_ns, hist_ns);
+    TEST_ASSERT_EQUAL(METRICS_BENCH_OPS, atomic_load(&counter->value));
+    uint32_t recorded = 0;
+    for (int i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++) {
+        recorded += atomic_load(&hist->buckets[i]);
+    }
+    TEST_ASSERT_EQUAL(METRICS_BENCH_OPS, recorded);
+    TEST_ASSERT_LESS_THAN(COUNTER_BUDGET_NS, (int)counter_ns);
+    TEST_ASSERT_LESS_THAN(HISTOGRAM_BUDGET_NS, (int)hist_ns);
+}
@@ -0,0 +1,303 @@
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "mp3_frame.h"
+#include "mp3_index.h"
+#include "mp3_decoder.h"
+
+/*
+ * data/ref.mp3 is a 1 s sweep + tone pair (44.1 kHz stereo, LAME -V2, no tags)
+ * and data/ref.pcm the first 16 frames of it as decoded by FFmpeg's
+ * fixed-point decoder:
+ *   ffmpeg -f lavfi -i "aevalsrc=0.5*sin(2*PI*(200+1500*t)*t)|0.35*sin(2*PI*1000*t)+0.1*sin(2*PI*5000*t):s=44100:d=1" \
+ *          -c:a libmp3lame -q:a 2 -write_xing 0 -id3v2_version 0 ref.mp3
+ *   ffmpeg -c:a mp3 -i ref.mp3 -f s16le - | head -c 73728 > ref.pcm
+ */
+extern const uint8_t ref_mp3_start[] asm("_binary_ref_mp3_start");
+extern const uint8_t ref_mp3_end[] asm("_binary_ref_mp3_end");
+extern const uint8_t ref_pcm_start[] asm("_binary_ref_pcm_start");
+extern const uint8_t ref_pcm_end[] asm("_binary_ref_pcm_end");
+
+#define REF_FRAMES 40
+#define REF_SAMPLES_PER_FRAME 1152
+#define MIN_PSNR_DB 60.0
+#define MAX_LAG_FRAMES 576
+#define BENCH_PASSES 25
+
+typedef struct {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    size_t bytes_read;
+} mem_source_t;
+
+static int mem_read(void *ctx, void *buf, size_t len) {
+    mem_source_t *src = ctx;
+    size_t n = src->size - src->pos < len ? src->size - src->pos : len;
+    memcpy(buf, src->data + src->pos, n);
+    src->pos += n;
+    src->bytes_read += n;
+    return (int)n;
+}
+
+static esp_err_t mem_seek(void *ctx, uint32_t offset) {
+    mem_source_t *src = ctx;
+    if (offset > src->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    src->pos = offset;
+    return ESP_OK;
+}
+
+static int mem_read_at(void *ctx, uint32_t offset, void *buf, size_t len) {
+    mem_source_t *src = ctx;
+    src->pos = offset < src->size ? offset : src->size;
+    return mem_read(ctx, buf, len);
+}
+
+static void open_ref(mem_source_t *src, mp3_source_t *source) {
+    memset(src, 0, sizeof(*src));
+    src->data = ref_mp3_start;
+    src->size = ref_mp3_end - ref_mp3_start;
+    source->read = mem_read;
+    source->seek = mem_seek;
+    source->ctx = src;
+}
+
+static double psnr(const int16_t *a, const int16_t *b, size_t samples) {
+    double err = 0;
+    for (size_t i = 0; i < samples; i++) {
+        double d = (double)a[i] - b[i];
+        err += d * d;
+    }
+    if (err == 0) {
+        return INFINITY;
+    }
+    return 10 * log10(32767.0 * 32767.0 * samples / err);
+}
+
+/* Decoders may disagree on the output delay; line the signals up before comparing. */
+static double best_psnr(const int16_t *out, const int16_t *ref, size_t frames, int *best_lag) {
+    double best = -INFINITY;
+    for (int lag = -MAX_LAG_FRAMES; lag <= MAX_LAG_FRAMES; lag++) {
+        size_t skip = abs(lag);
+        const int16_t *a = lag >= 0 ? out + 2 * skip : out;
+        const int16_t *b = lag >= 0 ? ref : ref + 2 * skip;
+        double p = psnr(a, b, 2 * (frames - skip));
+        if (p > best) {
+            best = p;
+            *best_lag = lag;
+        }
+    }
+    return best;
+}
+
+static int16_t decoded[(REF_FRAMES + 1) * MP3_DECODER_MAX_FRAMES * MP3_DECODER_CHANNELS];
+
+static void decode_all(mp3_decoder_t *dec, int16_t *pcm, uint32_t *frames) {
+    mp3_frame_info_t info;
+    uint32_t n = 0;
+    while (n <= REF_FRAMES && mp3_decoder_decode(dec, pcm + n * REF_SAMPLES_PER_FRAME * 2, &info) == ESP_OK) {
+        TEST_ASSERT_EQUAL(REF_SAMPLES_PER_FRAME, info.frames);
+        TEST_ASSERT_EQUAL(44100, info.sample_rate);
+        n++;
+    }
+    *frames = n;
+}
+
+TEST_CASE("mp3 frame headers and tags parse", "[mp3_decoder]") {
+    mp3_frame_header_t h;
+    TEST_ASSERT_TRUE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xFB, 0x90, 0x64 }, &h));
+    TEST_ASSERT_EQUAL(MP3_VERSION_1, h.version);
+    TEST_ASSERT_EQUAL(128, h.bitrate_kbps);
+    TEST_ASSERT_EQUAL(44100, h.sample_rate);
+    TEST_ASSERT_EQUAL(2, h.channels);
+    TEST_ASSERT_EQUAL(1152, h.samples);
+    TEST_ASSERT_EQUAL(417, h.frame_bytes);
+    TEST_ASSERT_TRUE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xFB, 0x92, 0x64 }, &h));
+    TEST_ASSERT_EQUAL(418, h.frame_bytes);
+
+    TEST_ASSERT_TRUE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xF3, 0x88, 0xC4 }, &h));
+    TEST_ASSERT_EQUAL(MP3_VERSION_2, h.version);
+    TEST_ASSERT_EQUAL(16000, h.sample_rate);
+    TEST_ASSERT_EQUAL(1, h.channels);
+    TEST_ASSERT_EQUAL(576, h.samples);
+    TEST_ASSERT_EQUAL(288, h.frame_bytes);
+
+    /* Layer II, free format and a reserved sample rate. */
+    TEST_ASSERT_FALSE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xFD, 0x90, 0x64 }, &h));
+    TEST_ASSERT_FALSE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xFB, 0x00, 0x64 }, &h));
+    TEST_ASSERT_FALSE(mp3_frame_parse((const uint8_t[]){ 0xFF, 0xFB, 0x9C, 0x64 }, &h));
+
+    const uint8_t id3[10] = { 'I', 'D', '3', 4, 0, 0x10, 0, 0, 2, 1 };
+    TEST_ASSERT_EQUAL(10 + 257 + 10, mp3_id3v2_size(id3, sizeof(id3)));
+    TEST_ASSERT_EQUAL(0, mp3_id3v2_size(ref_mp3_start, 10));
+}
+
+TEST_CASE("mp3 index built while decoding matches a header scan", "[mp3_decoder]") {
+    mem_source_t src;
+    mp3_source_t source;
+    mp3_index_t built, scanned, loaded;
+    mp3_decoder_t *dec;
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_create(&dec));
+    open_ref(&src, &source);
+    mp3_index_init(&built, 0);
+    mp3_decoder_open(dec, &source, &built);
+    uint32_t frames;
+    decode_all(dec, decoded, &frames);
+    TEST_ASSERT_EQUAL(REF_FRAMES, frames);
+    TEST_ASSERT_TRUE(built.complete);
+
+    open_ref(&src, &source);
+    mp3_index_init(&scanned, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_index_scan(&scanned, mem_read_at, &src, UINT32_MAX));
+    printf("mp3 index: %u frames, %u anchors, %u ms, scan read %u bytes\n", (unsigned)scanned.frames,
+           (unsigned)scanned.count, (unsigned)mp3_index_duration_ms(&scanned), (unsigned)src.bytes_read);
+    TEST_ASSERT_TRUE(scanned.complete);
+    TEST_ASSERT_EQUAL(built.frames, scanned.frames);
+    TEST_ASSERT_EQUAL(built.count, scanned.count);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(built.anchors, scanned.anchors, built.count);
+    TEST_ASSERT_EQUAL(src.size, scanned.next_offset);
+    TEST_ASSERT_EQUAL(1044, mp3_index_duration_ms(&scanned));
+
+    uint32_t anchor_frame, anchor_offset;
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_index_locate(&scanned, 37, &anchor_frame, &anchor_offset));
+    TEST_ASSERT_EQUAL(32, anchor_frame);
+    TEST_ASSERT_EQUAL(scanned.anchors[2], anchor_offset);
+    TEST_ASSERT_EQUAL(21, mp3_index_frame_at_ms(&scanned, 560));
+
+    FILE *f = tmpfile();
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_index_save(&scanned, f));
+    rewind(f);
+    mp3_index_init(&loaded, 0);
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_index_load(&loaded, f));
+    fclose(f);
+    TEST_ASSERT_EQUAL(scanned.frames, loaded.frames);
+    TEST_ASSERT_EQUAL_UINT32_ARRAY(scanned.anchors, loaded.anchors, scanned.count);
+
+    bool hit;
+    mp3_index_t *cached = mp3_index_cache_get("ref.mp3", &hit);
+    TEST_ASSERT_FALSE(hit);
+    TEST_ASSERT_TRUE(cached == mp3_index_cache_get("ref.mp3", &hit));
+    TEST_ASSERT_TRUE(hit);
+    /* Same FNV-1a hash, different keys: a separate slot each. */
+    mp3_index_t *first = mp3_index_cache_get("costarring", &hit);
+    TEST_ASSERT_FALSE(hit);
+    TEST_ASSERT_TRUE(first != mp3_index_cache_get("liquid", &hit));
+    TEST_ASSERT_FALSE(hit);
+
+    mp3_index_free(&built);
+    mp3_index_free(&scanned);
+    mp3_index_free(&loaded);
+    mp3_decoder_destroy(dec);
+}
+
+TEST_CASE("mp3 decoder matches the reference decoder", "[mp3_decoder]") {
+    mem_source_t src;
+    mp3_source_t source;
+    mp3_decoder_t *dec;
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_create(&dec));
+    open_ref(&src, &source);
+    mp3_decoder_open(dec, &source, NULL);
+    uint32_t frames;
+    decode_all(dec, decoded, &frames);
+
+    const int16_t *ref = (const int16_t *)ref_pcm_start;
+    size_t ref_frames = (ref_pcm_end - ref_pcm_start) / (MP3_DECODER_CHANNELS * sizeof(int16_t));
+    int lag;
+    double db = best_psnr(decoded, ref, ref_frames, &lag);
+    printf("mp3 decode vs reference: %.1f dB PSNR at lag %d over %u frames\n", db, lag, (unsigned)ref_frames);
+    TEST_ASSERT_GREATER_THAN_DOUBLE(MIN_PSNR_DB, db);
+
+    mp3_decoder_stats_t stats;
+    mp3_decoder_get_stats(dec, &stats);
+    TEST_ASSERT_EQUAL(REF_FRAMES, stats.frames_decoded);
+    TEST_ASSERT_EQUAL(0, stats.decode_errors);
+    TEST_ASSERT_EQUAL(0, stats.resyncs);
+    mp3_decoder_destroy(dec);
+}
+
+TEST_CASE("mp3 seek through the index lands on the same audio", "[mp3_decoder]") {
+    mem_source_t src;
+    mp3_source_t source;
+    mp3_index_t index;
+    mp3_decoder_t *dec;
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_create(&dec));
+    open_ref(&src, &source);
+    mp3_index_init(&index, 0);
+    mp3_decoder_open(dec, &source, &index);
+    uint32_t frames;
+    decode_all(dec, decoded, &frames);
+    TEST_ASSERT_TRUE(index.complete);
+
+    static int16_t pcm[MP3_DECODER_MAX_FRAMES * MP3_DECODER_CHANNELS];
+    mp3_frame_info_t info;
+    const uint32_t targets[] = { 30, 5, 21, 38 };
+    for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+        uint32_t target = targets[i];
+        src.bytes_read = 0;
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_seek(dec, target));
+        TEST_ASSERT_EQUAL(target, mp3_decoder_tell(dec));
+        TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_decode(dec, pcm, &info));
+        int64_t elapsed = esp_timer_get_time() - start;
+        double db = psnr(pcm, decoded + target * REF_SAMPLES_PER_FRAME * 2, REF_SAMPLES_PER_FRAME * 2);
+        printf("mp3 seek to frame %2u: %lld us, %u bytes read, %.1f dB vs linear decode\n", (unsigned)target,
+               (long long)elapsed, (unsigned)src.bytes_read, db);
+        TEST_ASSERT_GREATER_THAN_DOUBLE(MIN_PSNR_DB, db);
+        TEST_ASSERT_EQUAL(target + 1, mp3_decoder_tell(dec));
+    }
+
+    /* Without an index the same seek has to walk every header from the start. */
+    open_ref(&src, &source);
+    mp3_decoder_open(dec, &source, NULL);
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_seek(dec, 38));
+    mp3_decoder_stats_t stats;
+    mp3_decoder_get_stats(dec, &stats);
+    TEST_ASSERT_EQUAL(38 - MP3_DECODER_PRIME_FRAMES, stats.frames_skipped);
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, mp3_decoder_seek(dec, REF_FRAMES + 10));
+
+    mp3_index_free(&index);
+    mp3_decoder_destroy(dec);
+}
+
+TEST_CASE("mp3 decode time per frame and memory", "[mp3_decoder]") {
+    struct mallinfo2 before = mallinfo2();
+    mp3_decoder_t *dec;
+    TEST_ASSERT_EQUAL(ESP_OK, mp3_decoder_create(&dec));
+    struct mallinfo2 created = mallinfo2();
+
+    mem_source_t src;
+    mp3_source_t source;
+    static int16_t pcm[MP3_DECODER_MAX_FRAMES * MP3_DECODER_CHANNELS];
+    mp3_frame_info_t info;
+    uint32_t frames = 0;
+    int64_t start = esp_timer_get_time();
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        open_ref(&src, &source);
+        mp3_decoder_open(dec, &source, NULL);
+        while (mp3_decoder_decode(dec, pcm, &info) == ESP_OK) {
+            frames++;
+        }
+    }
+    int64_t elapsed = esp_timer_get_time() - start;
+    struct mallinfo2 after = mallinfo2();
+
+    mp3_decoder_stats_t stats;
+    mp3_decoder_get_stats(dec, &stats);
+    double us_per_frame = (double)elapsed / frames;
+    double frame_us = 1e6 * REF_SAMPLES_PER_FRAME / 44100;
+    printf("mp3 decode: %.1f us/frame avg, %u us worst, %.0fx realtime on host\n", us_per_frame,
+           (unsigned)stats.max_decode_us, frame_us / us_per_frame);
+    printf("mp3 decode memory: %u bytes heap (decoder + input buffer), %u bytes PCM out per frame, "
+           "%u bytes heap growth while decoding\n", (unsigned)(created.uordblks - before.uordblks),
+           (unsigned)sizeof(pcm), (unsigned)(after.uordblks - created.uordblks));
+    TEST_ASSERT_EQUAL(REF_FRAMES * BENCH_PASSES, frames);
+    TEST_ASSERT_EQUAL(created.uordblks, after.uordblks);
+    mp3_decoder_destroy(dec);
+}
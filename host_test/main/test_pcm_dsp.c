@@ -0,0 +1,421 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "pcm_volume.h"
+#include "pcm_biquad.h"
+#include "pcm_resampler.h"
+#include "pcm_ring.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_CYCLES 1
+#endif
+
+#define OUT_RATE 44100
+#define TEST_FRAMES 44100
+#define BLOCK_FRAMES 256
+#define BENCH_PASSES 20
+/*
+ * Signal to error energy against a double-precision reference. Rounding to
+ * 16 bits alone limits these signals to roughly 80-90 dB.
+ */
+#define VOLUME_MIN_SNR_DB 85.0
+#define BIQUAD_MIN_SNR_DB 75.0
+#define RESAMPLE_MIN_SNR_DB 70.0
+#define RESAMPLE_MIN_REJECTION_DB 65.0
+/* As CONFIG_AUDIO_PCM_RING_FRAMES and the output task's block. */
+#define PIPE_RING_FRAMES 4608
+#define PIPE_BLOCK_FRAMES 256
+#define MPEG2_FRAME 576
+
+static int16_t in_pcm[2 * TEST_FRAMES * 2];
+static int16_t out_pcm[2 * TEST_FRAMES * 2];
+static double ref[2 * TEST_FRAMES * 2];
+static int16_t ref_pcm[2 * TEST_FRAMES * 2];
+
+static uint32_t lcg = 12345;
+
+static int16_t noise(int amplitude) {
+    lcg = lcg * 1664525 + 1013904223;
+    return (int16_t)((int16_t)(lcg >> 16) % amplitude);
+}
+
+static void make_tone(int16_t *pcm, size_t frames, uint32_t rate, double freq, double amplitude) {
+    for (size_t i = 0; i < frames; i++) {
+        int16_t s = (int16_t)lround(amplitude * 32767.0 * sin(2.0 * M_PI * freq * i / rate));
+        pcm[2 * i] = s;
+        pcm[2 * i + 1] = (int16_t)-s;
+    }
+}
+
+static double snr_db(const int16_t *out, const double *expected, size_t samples) {
+    double signal = 0, err = 0;
+    for (size_t i = 0; i < samples; i++) {
+        double d = out[i] - expected[i];
+        signal += expected[i] * expected[i];
+        err += d * d;
+    }
+    return err == 0 ? INFINITY : 10 * log10(signal / err);
+}
+
+static double rms(const int16_t *pcm, size_t samples) {
+    double sum = 0;
+    for (size_t i = 0; i < samples; i++) {
+        sum += (double)pcm[i] * pcm[i];
+    }
+    return sqrt(sum / samples);
+}
+
+static uint64_t bench_now(void) {
+#if BENCH_HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+TEST_CASE("pcm volume matches double reference and ramps without steps", "[pcm_dsp]") {
+    pcm_volume_t vol;
+    for (size_t i = 0; i < 2 * TEST_FRAMES; i++) {
+        in_pcm[i] = noise(32768);
+    }
+
+    const float db = -6.0f;
+    double gain = pow(10.0, db / 20.0);
+    memcpy(out_pcm, in_pcm, 2 * TEST_FRAMES * sizeof(int16_t));
+    pcm_volume_init(&vol, pcm_volume_gain_from_db(db));
+    for (size_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES) {
+        size_t n = TEST_FRAMES - i < BLOCK_FRAMES ? TEST_FRAMES - i : BLOCK_FRAMES;
+        pcm_volume_process(&vol, out_pcm + 2 * i, n);
+    }
+    for (size_t i = 0; i < 2 * TEST_FRAMES; i++) {
+        ref[i] = in_pcm[i] * gain;
+    }
+    double db_snr = snr_db(out_pcm, ref, 2 * TEST_FRAMES);
+    printf("pcm volume %.0f dB vs double: %.1f dB SNR\n", db, db_snr);
+    TEST_ASSERT_GREATER_THAN_DOUBLE(VOLUME_MIN_SNR_DB, db_snr);
+
+    /* Unity and silence are exact. */
+    memcpy(out_pcm, in_pcm, 2 * BLOCK_FRAMES * sizeof(int16_t));
+    pcm_volume_init(&vol, PCM_VOLUME_UNITY);
+    pcm_volume_process(&vol, out_pcm, BLOCK_FRAMES);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(in_pcm, out_pcm, 2 * BLOCK_FRAMES);
+    pcm_volume_set(&vol, 0, 0);
+    pcm_volume_process(&vol, out_pcm, BLOCK_FRAMES);
+    for (size_t i = 0; i < 2 * BLOCK_FRAMES; i++) {
+        TEST_ASSERT_EQUAL(0, out_pcm[i]);
+    }
+
+    /* A fade to silence over 1000 frames, in blocks that do not line up with it. */
+    const size_t ramp = 1000;
+    const int16_t level = 16384;
+    for (size_t i = 0; i < 2 * 2 * ramp; i++) {
+        out_pcm[i] = level;
+    }
+    pcm_volume_init(&vol, PCM_VOLUME_UNITY);
+    pcm_volume_set(&vol, 0, ramp);
+    for (size_t i = 0; i < 2 * ramp; i += 64) {
+        pcm_volume_process(&vol, out_pcm + 2 * i, 64);
+    }
+    int max_step = 0;
+    for (size_t i = 1; i < 2 * ramp; i++) {
+        int step = out_pcm[2 * (i - 1)] - out_pcm[2 * i];
+        TEST_ASSERT_GREATER_OR_EQUAL(0, step);
+        TEST_ASSERT_EQUAL(out_pcm[2 * i], out_pcm[2 * i + 1]);
+        max_step = step > max_step ? step : max_step;
+    }
+    TEST_ASSERT_EQUAL(level, out_pcm[0]);
+    TEST_ASSERT_INT_WITHIN(level / 100, level / 2, out_pcm[2 * (ramp / 2)]);
+    TEST_ASSERT_EQUAL(0, out_pcm[2 * ramp]);
+    TEST_ASSERT_LESS_OR_EQUAL(level / ramp + 2, max_step);
+}
+
+static void biquad_reference(const pcm_biquad_t *bq, const int16_t *in, double *out, size_t frames) {
+    double b0 = bq->b0 / (double)(1 << PCM_BIQUAD_FRAC_BITS), b1 = bq->b1 / (double)(1 << PCM_BIQUAD_FRAC_BITS);
+    double b2 = bq->b2 / (double)(1 << PCM_BIQUAD_FRAC_BITS), a1 = bq->a1 / (double)(1 << PCM_BIQUAD_FRAC_BITS);
+    double a2 = bq->a2 / (double)(1 << PCM_BIQUAD_FRAC_BITS);
+    for (int ch = 0; ch < 2; ch++) {
+        double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+        for (size_t i = 0; i < frames; i++) {
+            double x = in[2 * i + ch];
+            double y = b0 * x + b1 * x1 + b2 * x2 - a1 * y1 - a2 * y2;
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            out[2 * i + ch] = y;
+        }
+    }
+}
+
+TEST_CASE("pcm biquad matches double reference", "[pcm_dsp]") {
+    static const struct {
+        pcm_biquad_type_t type;
+        float freq, q, gain_db;
+        const char *name;
+    } cases[] = {
+        { PCM_BIQUAD_PEAK, 1000, 1.0f, 6.0f, "peak 1 kHz +6 dB" },
+        { PCM_BIQUAD_LOW_SHELF, 100, 0.707f, 9.0f, "low shelf 100 Hz +9 dB" },
+        { PCM_BIQUAD_HIGH_SHELF, 8000, 0.707f, -6.0f, "high shelf 8 kHz -6 dB" },
+    };
+    pcm_biquad_t bq;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        TEST_ASSERT_EQUAL(ESP_OK, pcm_biquad_design(&bq, cases[c].type, OUT_RATE, cases[c].freq, cases[c].q,
+                                                    cases[c].gain_db));
+        /* Low, mid and high tones plus a little noise, with headroom for the boost. */
+        for (size_t i = 0; i < TEST_FRAMES; i++) {
+            double t = (double)i / OUT_RATE;
+            double s = 0.12 * sin(2 * M_PI * 40 * t) + 0.12 * sin(2 * M_PI * 1000 * t) + 0.12 * sin(2 * M_PI * 12000 * t);
+            in_pcm[2 * i] = (int16_t)lround(s * 32767.0) + noise(64);
+            in_pcm[2 * i + 1] = (int16_t)lround(-s * 32767.0) + noise(64);
+        }
+        memcpy(out_pcm, in_pcm, 2 * TEST_FRAMES * sizeof(int16_t));
+        for (size_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES) {
+            size_t n = TEST_FRAMES - i < BLOCK_FRAMES ? TEST_FRAMES - i : BLOCK_FRAMES;
+            pcm_biquad_process(&bq, out_pcm + 2 * i, n);
+        }
+        biquad_reference(&bq, in_pcm, ref, TEST_FRAMES);
+        double db = snr_db(out_pcm, ref, 2 * TEST_FRAMES);
+        printf("pcm biquad %s vs double: %.1f dB SNR\n", cases[c].name, db);
+        TEST_ASSERT_GREATER_THAN_DOUBLE(BIQUAD_MIN_SNR_DB, db);
+    }
+
+    /* The design itself: a peak's gain at its centre frequency. */
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_biquad_design(&bq, PCM_BIQUAD_PEAK, OUT_RATE, 1000, 1.0f, 6.0f));
+    make_tone(in_pcm, TEST_FRAMES, OUT_RATE, 1000, 0.25);
+    memcpy(out_pcm, in_pcm, 2 * TEST_FRAMES * sizeof(int16_t));
+    pcm_biquad_process(&bq, out_pcm, TEST_FRAMES);
+    double gain_db = 20 * log10(rms(out_pcm + OUT_RATE / 2, TEST_FRAMES) / rms(in_pcm + OUT_RATE / 2, TEST_FRAMES));
+    TEST_ASSERT_DOUBLE_WITHIN(0.05, 6.0, gain_db);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, pcm_biquad_design(&bq, PCM_BIQUAD_PEAK, OUT_RATE, 30000, 1.0f, 0.0f));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, pcm_biquad_design(&bq, PCM_BIQUAD_HIGH_SHELF, OUT_RATE, 8000, 0.707f,
+                                                             30.0f));
+}
+
+/* Runs all of in through the resampler in uneven chunks, as the output task would. */
+static size_t resample(pcm_resampler_t *rs, const int16_t *in, size_t in_frames, int16_t *out, size_t out_max,
+                       size_t in_chunk, size_t out_chunk) {
+    size_t taken = 0, produced = 0;
+    while (produced < out_max) {
+        size_t avail = in_frames - taken < in_chunk ? in_frames - taken : in_chunk;
+        size_t want = out_max - produced < out_chunk ? out_max - produced : out_chunk;
+        size_t n = avail;
+        size_t made = pcm_resampler_process(rs, in + 2 * taken, &n, out + 2 * produced, want);
+        taken += n;
+        produced += made;
+        if (made == 0 && n == 0) {
+            break;
+        }
+    }
+    return produced;
+}
+
+TEST_CASE("pcm resampler converts 48, 32 and 22.05 kHz to 44.1 kHz", "[pcm_dsp]") {
+    static const struct {
+        uint32_t rate;
+        double tones[2];
+        double reject;          /* above the output Nyquist rate, must not alias back in */
+    } cases[] = {
+        { 48000, { 1000, 15000 }, 23500 },
+        { 32000, { 1000, 10000 }, 0 },
+        { 22050, { 1000, 8000 }, 0 },
+    };
+    pcm_resampler_t *rs;
+
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        uint32_t rate = cases[c].rate;
+        TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(rate, OUT_RATE, &rs));
+        size_t in_frames = rate;
+        size_t out_frames = (size_t)((uint64_t)in_frames * OUT_RATE / rate) - 2 * PCM_RESAMPLER_TAPS;
+        double delay = pcm_resampler_delay(rs);
+        size_t settle = 2 * PCM_RESAMPLER_TAPS;
+
+        for (int t = 0; t < 2; t++) {
+            double freq = cases[c].tones[t];
+            make_tone(in_pcm, in_frames, rate, freq, 0.5);
+            pcm_resampler_reset(rs);
+            TEST_ASSERT_EQUAL(out_frames, resample(rs, in_pcm, in_frames, out_pcm, out_frames, 1152, BLOCK_FRAMES));
+            for (size_t i = 0; i < out_frames; i++) {
+                double s = 0.5 * 32767.0 * sin(2.0 * M_PI * freq * ((double)i * rate / OUT_RATE - delay) / rate);
+                ref[2 * i] = s;
+                ref[2 * i + 1] = -s;
+            }
+            double db = snr_db(out_pcm + 2 * settle, ref + 2 * settle, 2 * (out_frames - settle));
+            printf("pcm resample %lu -> %d Hz, %.0f Hz tone vs double: %.1f dB SNR\n", (unsigned long)rate, OUT_RATE,
+                   freq, db);
+            TEST_ASSERT_GREATER_THAN_DOUBLE(RESAMPLE_MIN_SNR_DB, db);
+        }
+
+        /* Chunking must not change a single sample. */
+        static int16_t chunked[2 * TEST_FRAMES * 2];
+        pcm_resampler_reset(rs);
+        TEST_ASSERT_EQUAL(out_frames, resample(rs, in_pcm, in_frames, chunked, out_frames, 37, 53));
+        TEST_ASSERT_EQUAL_INT16_ARRAY(out_pcm, chunked, 2 * out_frames);
+
+        if (cases[c].reject > 0) {
+            make_tone(in_pcm, in_frames, rate, cases[c].reject, 0.5);
+            pcm_resampler_reset(rs);
+            resample(rs, in_pcm, in_frames, out_pcm, out_frames, 1152, BLOCK_FRAMES);
+            double db = 20 * log10(rms(out_pcm + 2 * settle, 2 * (out_frames - settle)) / (0.5 * 32767.0 / sqrt(2)));
+            printf("pcm resample %lu -> %d Hz, %.0f Hz tone: %.1f dB\n", (unsigned long)rate, OUT_RATE,
+                   cases[c].reject, db);
+            TEST_ASSERT_LESS_THAN_DOUBLE(-RESAMPLE_MIN_REJECTION_DB, db);
+        }
+        pcm_resampler_destroy(rs);
+    }
+
+    /* Every MPEG-1, 2 and 2.5 rate, into either common I2S rate. */
+    static const uint32_t mpeg_rates[] = { 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000 };
+    for (size_t i = 0; i < sizeof(mpeg_rates) / sizeof(mpeg_rates[0]); i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(mpeg_rates[i], OUT_RATE, &rs));
+        pcm_resampler_destroy(rs);
+        TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(mpeg_rates[i], 48000, &rs));
+        pcm_resampler_destroy(rs);
+    }
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, pcm_resampler_create(44101, OUT_RATE, &rs));
+}
+
+/*
+ * The output task's loop over the ring: the producer reserves room for a
+ * whole MPEG-1 frame but commits one 576-frame MPEG-2 granule pair, the
+ * consumer takes at most one block per pass and releases what the
+ * resampler took.
+ */
+TEST_CASE("pcm ring and resampler play 576-frame 22.05 kHz commits end to end", "[pcm_dsp]") {
+    static _Alignas(PCM_RING_STORAGE_ALIGN) int16_t storage[PIPE_RING_FRAMES * PCM_RING_CHANNELS];
+    static int16_t block[PIPE_BLOCK_FRAMES * PCM_RING_CHANNELS];
+    const uint32_t rate = 22050;
+    /* Several laps; 576 frames short of the end a 1152-frame reservation has to wrap early. */
+    const size_t in_frames = 40 * MPEG2_FRAME;
+    make_tone(in_pcm, in_frames, rate, 1000, 0.5);
+
+    pcm_resampler_t *direct, *rs;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(rate, OUT_RATE, &direct));
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(rate, OUT_RATE, &rs));
+    size_t expected = resample(direct, in_pcm, in_frames, ref_pcm, 2 * TEST_FRAMES, in_frames, 2 * TEST_FRAMES);
+    pcm_resampler_destroy(direct);
+
+    pcm_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, PIPE_RING_FRAMES));
+    size_t committed = 0, played = 0;
+    while (played < expected) {
+        int16_t *slot;
+        if (committed < in_frames && pcm_ring_write_reserve_block(&ring, &slot, 2 * MPEG2_FRAME)) {
+            memcpy(slot, in_pcm + 2 * committed, MPEG2_FRAME * PCM_RING_FRAME_BYTES);
+            pcm_ring_write_commit(&ring, MPEG2_FRAME);
+            committed += MPEG2_FRAME;
+            continue;
+        }
+        int16_t *frames;
+        size_t n = pcm_ring_read_acquire(&ring, &frames, PIPE_BLOCK_FRAMES);
+        size_t made = pcm_resampler_process(rs, frames, &n, block, PIPE_BLOCK_FRAMES);
+        pcm_ring_read_release(&ring, n);
+        if (made == 0 && n == 0) {
+            /* Neither side can move: only right once every frame is in. */
+            TEST_ASSERT_EQUAL(in_frames, committed);
+            break;
+        }
+        memcpy(out_pcm + 2 * played, block, made * PCM_RING_FRAME_BYTES);
+        played += made;
+    }
+    pcm_resampler_destroy(rs);
+
+    printf("pcm pipeline %lu Hz: %u frames in as %d-frame commits, %u out\n", (unsigned long)rate,
+           (unsigned)in_frames, MPEG2_FRAME, (unsigned)played);
+    TEST_ASSERT_EQUAL(in_frames, committed);
+    TEST_ASSERT_EQUAL(expected, played);
+    TEST_ASSERT_EQUAL_INT16_ARRAY(ref_pcm, out_pcm, 2 * played);
+}
+
+typedef struct {
+    uint64_t cycles;
+    int64_t us;
+    uint64_t start_cycles;
+    int64_t start_us;
+} bench_t;
+
+static void bench_start(bench_t *b) {
+    b->start_us = esp_timer_get_time();
+    b->start_cycles = bench_now();
+}
+
+static void bench_stop(bench_t *b) {
+    b->cycles += bench_now() - b->start_cycles;
+    b->us += esp_timer_get_time() - b->start_us;
+}
+
+/* Per-frame cost on this host, for comparison between stages and runs; not checked. */
+static void bench_report(bench_t *b, const char *stage, size_t frames) {
+    double ns = b->us * 1000.0 / frames;
+#if BENCH_HAVE_CYCLES
+    printf("pcm dsp %-24s %7.1f cycles/frame %7.1f ns/frame\n", stage, (double)b->cycles / frames, ns);
+#else
+    printf("pcm dsp %-24s %7.1f ns/frame\n", stage, ns);
+#endif
+    *b = (bench_t) { 0 };
+}
+
+/* The in-place stages work on a fresh copy each pass, so every pass sees the full-scale tone. */
+TEST_CASE("pcm dsp stages per-frame cost", "[pcm_dsp]") {
+    const size_t frames = (size_t)TEST_FRAMES * BENCH_PASSES;
+    const size_t bytes = 2 * TEST_FRAMES * sizeof(int16_t);
+    bench_t b = { 0 };
+    make_tone(in_pcm, 2 * TEST_FRAMES, OUT_RATE, 1000, 0.5);
+
+    pcm_volume_t vol;
+    pcm_volume_init(&vol, pcm_volume_gain_from_db(-12.0f));
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        memcpy(out_pcm, in_pcm, bytes);
+        bench_start(&b);
+        for (size_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES) {
+            pcm_volume_process(&vol, out_pcm + 2 * i, BLOCK_FRAMES);
+        }
+        bench_stop(&b);
+    }
+    bench_report(&b, "volume", frames);
+
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        memcpy(out_pcm, in_pcm, bytes);
+        bench_start(&b);
+        pcm_volume_set(&vol, pass & 1 ? PCM_VOLUME_UNITY / 4 : PCM_VOLUME_UNITY / 2, TEST_FRAMES);
+        for (size_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES) {
+            pcm_volume_process(&vol, out_pcm + 2 * i, BLOCK_FRAMES);
+        }
+        bench_stop(&b);
+    }
+    bench_report(&b, "volume ramp", frames);
+
+    pcm_biquad_t bq;
+    pcm_biquad_design(&bq, PCM_BIQUAD_PEAK, OUT_RATE, 1000, 1.0f, -3.0f);
+    for (int pass = 0; pass < BENCH_PASSES; pass++) {
+        memcpy(out_pcm, in_pcm, bytes);
+        bench_start(&b);
+        for (size_t i = 0; i < TEST_FRAMES; i += BLOCK_FRAMES) {
+            pcm_biquad_process(&bq, out_pcm + 2 * i, BLOCK_FRAMES);
+        }
+        bench_stop(&b);
+    }
+    bench_report(&b, "biquad (per band)", frames);
+
+    static const uint32_t rates[] = { 48000, 22050 };
+    for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+        pcm_resampler_t *rs;
+        TEST_ASSERT_EQUAL(ESP_OK, pcm_resampler_create(rates[r], OUT_RATE, &rs));
+        size_t in_frames = rates[r];
+        size_t produced = 0;
+        bench_start(&b);
+        for (int pass = 0; pass < BENCH_PASSES; pass++) {
+            produced += resample(rs, in_pcm, in_frames, out_pcm, 2 * TEST_FRAMES, 1152, BLOCK_FRAMES);
+        }
+        bench_stop(&b);
+        char stage[32];
+        snprintf(stage, sizeof(stage), "resample %lu Hz", (unsigned long)rates[r]);
+        bench_report(&b, stage, produced);
+        pcm_resampler_destroy(rs);
+    }
+}
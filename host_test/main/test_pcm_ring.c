@@ -0,0 +1,259 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "pcm_ring.h"
+
+#define STRESS_CAPACITY 1000
+#define STRESS_FRAMES (4 * 1000 * 1000)
+#define BENCH_BLOCK 256
+#define BENCH_FRAMES (8 * 1024 * 1024)
+
+static _Alignas(PCM_RING_STORAGE_ALIGN) int16_t storage[4608 * PCM_RING_CHANNELS];
+
+static void fill_frames(int16_t *frames, size_t n, uint32_t seq) {
+    for (size_t i = 0; i < n; i++) {
+        frames[2 * i] = (int16_t)(seq + i);
+        frames[2 * i + 1] = (int16_t)~(seq + i);
+    }
+}
+
+TEST_CASE("pcm ring rejects misaligned storage", "[pcm_ring]") {
+    pcm_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, pcm_ring_init(&ring, storage + 1, 64));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, pcm_ring_init(&ring, storage, 0));
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, 64));
+}
+
+TEST_CASE("pcm ring reserve/commit round trip without copies", "[pcm_ring]") {
+    pcm_ring_t ring;
+    int16_t *w, *r;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, 1152 * 4));
+
+    TEST_ASSERT_EQUAL(0, pcm_ring_read_acquire(&ring, &r, 1152));
+    TEST_ASSERT_EQUAL(1152, pcm_ring_write_reserve(&ring, &w, 1152));
+    TEST_ASSERT_TRUE(w == storage);
+    fill_frames(w, 1152, 0);
+    pcm_ring_write_commit(&ring, 1152);
+    TEST_ASSERT_EQUAL(1152, pcm_ring_fill(&ring));
+
+    /* The consumer sees the very bytes the producer wrote. */
+    TEST_ASSERT_EQUAL(1000, pcm_ring_read_acquire(&ring, &r, 1000));
+    TEST_ASSERT_TRUE(r == w);
+    pcm_ring_read_release(&ring, 1000);
+    TEST_ASSERT_EQUAL(152, pcm_ring_fill(&ring));
+
+    /* Empty before the first commit is not an underrun; running dry afterwards is, once. */
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&ring, &stats);
+    TEST_ASSERT_EQUAL(0, stats.underruns);
+    TEST_ASSERT_EQUAL(152, pcm_ring_read_acquire(&ring, &r, 1152));
+    pcm_ring_read_release(&ring, 152);
+    TEST_ASSERT_EQUAL(0, pcm_ring_read_acquire(&ring, &r, 1152));
+    TEST_ASSERT_EQUAL(0, pcm_ring_read_acquire(&ring, &r, 1152));
+    pcm_ring_get_stats(&ring, &stats);
+    TEST_ASSERT_EQUAL(1, stats.underruns);
+    TEST_ASSERT_EQUAL(0, stats.producer_waits);
+}
+
+TEST_CASE("pcm ring wraps whole blocks and counts producer waits", "[pcm_ring]") {
+    pcm_ring_t ring;
+    int16_t *w, *r;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, 1152 * 3));
+    uint32_t written = 0, read = 0;
+
+    for (int round = 0; round < 1000; round++) {
+        /* Whole blocks never straddle the wrap because the capacity is a multiple of the block. */
+        while (pcm_ring_space(&ring) >= 1152) {
+            TEST_ASSERT_EQUAL(1152, pcm_ring_write_reserve(&ring, &w, 1152));
+            fill_frames(w, 1152, written);
+            pcm_ring_write_commit(&ring, 1152);
+            written += 1152;
+        }
+        /* Drain in odd-sized pieces so the read side hits every wrap offset. */
+        size_t n = pcm_ring_read_acquire(&ring, &r, 333 + round % 7);
+        for (size_t i = 0; i < n; i++) {
+            TEST_ASSERT_EQUAL_INT16((int16_t)(read + i), r[2 * i]);
+        }
+        pcm_ring_read_release(&ring, n);
+        read += n;
+    }
+    TEST_ASSERT_EQUAL(written - read, pcm_ring_fill(&ring));
+
+    size_t n;
+    while ((n = pcm_ring_write_reserve(&ring, &w, 1152)) > 0) {
+        pcm_ring_write_commit(&ring, n);
+    }
+    /* Polling a full ring is one wait, however often it polls. */
+    TEST_ASSERT_EQUAL(0, pcm_ring_write_reserve(&ring, &w, 1152));
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&ring, &stats);
+    TEST_ASSERT_EQUAL(1, stats.producer_waits);
+    TEST_ASSERT_EQUAL(1152 * 3, stats.fill);
+}
+
+/*
+ * The decoder reserves room for the largest frame (1152) but MPEG-2 and 2.5
+ * streams commit 576 at a time, so the write index lands where a whole
+ * reservation no longer fits before the end; it has to wrap early.
+ */
+static void run_short_frames(size_t capacity) {
+    pcm_ring_t ring;
+    int16_t *w, *r;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, capacity));
+    uint32_t written = 0, read = 0;
+
+    /* 40 frames: several laps of either ring. */
+    while (written < 40 * 576) {
+        if (pcm_ring_write_reserve_block(&ring, &w, 1152)) {
+            TEST_ASSERT_TRUE(w + 1152 * PCM_RING_CHANNELS <= storage + capacity * PCM_RING_CHANNELS);
+            fill_frames(w, 576, written);
+            pcm_ring_write_commit(&ring, 576);
+            written += 576;
+            continue;
+        }
+        /* Ring full: drain a piece, as the output task would, and try again. */
+        size_t n = pcm_ring_read_acquire(&ring, &r, 256);
+        TEST_ASSERT_GREATER_THAN(0, n);
+        for (size_t i = 0; i < n; i++) {
+            TEST_ASSERT_EQUAL_INT16((int16_t)(read + i), r[2 * i]);
+        }
+        pcm_ring_read_release(&ring, n);
+        read += n;
+    }
+    size_t n;
+    while ((n = pcm_ring_read_acquire(&ring, &r, 256)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            TEST_ASSERT_EQUAL_INT16((int16_t)(read + i), r[2 * i]);
+        }
+        pcm_ring_read_release(&ring, n);
+        read += n;
+    }
+    TEST_ASSERT_EQUAL(written, read);
+    TEST_ASSERT_EQUAL(40 * 576, read);
+    TEST_ASSERT_EQUAL(0, pcm_ring_fill(&ring));
+}
+
+TEST_CASE("pcm ring wraps early for 576-frame commits", "[pcm_ring]") {
+    run_short_frames(1152 * 4);
+    /* Not a multiple of either frame size. */
+    run_short_frames(1000 * 3);
+}
+
+typedef struct {
+    pcm_ring_t ring;
+    uint32_t errors;
+} stress_t;
+
+static void *stress_producer(void *arg) {
+    stress_t *st = arg;
+    uint32_t seq = 0;
+    unsigned rnd = 1;
+    while (seq < STRESS_FRAMES) {
+        int16_t *w;
+        rnd = rnd * 1103515245 + 12345;
+        size_t want = 1 + (rnd >> 16) % 300;
+        if (want > STRESS_FRAMES - seq) {
+            want = STRESS_FRAMES - seq;
+        }
+        size_t n = pcm_ring_write_reserve(&st->ring, &w, want);
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        fill_frames(w, n, seq);
+        pcm_ring_write_commit(&st->ring, n);
+        seq += n;
+    }
+    return NULL;
+}
+
+static void *stress_consumer(void *arg) {
+    stress_t *st = arg;
+    uint32_t seq = 0;
+    unsigned rnd = 7;
+    while (seq < STRESS_FRAMES) {
+        int16_t *r;
+        rnd = rnd * 1103515245 + 12345;
+        size_t n = pcm_ring_read_acquire(&st->ring, &r, 1 + (rnd >> 16) % 300);
+        if (n == 0) {
+            sched_yield();
+            continue;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (r[2 * i] != (int16_t)(seq + i) || r[2 * i + 1] != (int16_t)~(seq + i)) {
+                st->errors++;
+            }
+        }
+        pcm_ring_read_release(&st->ring, n);
+        seq += n;
+    }
+    return NULL;
+}
+
+TEST_CASE("pcm ring survives concurrent producer and consumer", "[pcm_ring]") {
+    static stress_t st;
+    st.errors = 0;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&st.ring, storage, STRESS_CAPACITY));
+
+    pthread_t producer, consumer;
+    int64_t start = esp_timer_get_time();
+    TEST_ASSERT_EQUAL(0, pthread_create(&consumer, NULL, stress_consumer, &st));
+    TEST_ASSERT_EQUAL(0, pthread_create(&producer, NULL, stress_producer, &st));
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&st.ring, &stats);
+    printf("pcm_ring stress: %d frames in %lld ms, %u producer waits, %u underruns\n", STRESS_FRAMES,
+           (long long)(elapsed / 1000), (unsigned)stats.producer_waits, (unsigned)stats.underruns);
+    TEST_ASSERT_EQUAL(0, st.errors);
+    TEST_ASSERT_EQUAL(0, stats.fill);
+}
+
+/*
+ * Same producer/consumer work both ways: the ring hands out the slot to
+ * render into, while a queue needs a staging block on each side and copies
+ * it in and out.
+ */
+TEST_CASE("pcm ring throughput vs FreeRTOS queue", "[pcm_ring]") {
+    pcm_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_OK, pcm_ring_init(&ring, storage, BENCH_BLOCK * 8));
+    uint64_t checksum_ring = 0, checksum_queue = 0;
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t seq = 0; seq < BENCH_FRAMES; seq += BENCH_BLOCK) {
+        int16_t *w, *r;
+        TEST_ASSERT_EQUAL(BENCH_BLOCK, pcm_ring_write_reserve(&ring, &w, BENCH_BLOCK));
+        fill_frames(w, BENCH_BLOCK, seq);
+        pcm_ring_write_commit(&ring, BENCH_BLOCK);
+        TEST_ASSERT_EQUAL(BENCH_BLOCK, pcm_ring_read_acquire(&ring, &r, BENCH_BLOCK));
+        checksum_ring += (uint16_t)r[0] + (uint16_t)r[2 * BENCH_BLOCK - 1];
+        pcm_ring_read_release(&ring, BENCH_BLOCK);
+    }
+    int64_t ring_us = esp_timer_get_time() - start;
+
+    QueueHandle_t queue = xQueueCreate(8, BENCH_BLOCK * PCM_RING_FRAME_BYTES);
+    TEST_ASSERT_NOT_NULL(queue);
+    static int16_t staging_in[BENCH_BLOCK * PCM_RING_CHANNELS];
+    static int16_t staging_out[BENCH_BLOCK * PCM_RING_CHANNELS];
+    start = esp_timer_get_time();
+    for (uint32_t seq = 0; seq < BENCH_FRAMES; seq += BENCH_BLOCK) {
+        fill_frames(staging_in, BENCH_BLOCK, seq);
+        TEST_ASSERT_EQUAL(pdTRUE, xQueueSend(queue, staging_in, 0));
+        TEST_ASSERT_EQUAL(pdTRUE, xQueueReceive(queue, staging_out, 0));
+        checksum_queue += (uint16_t)staging_out[0] + (uint16_t)staging_out[2 * BENCH_BLOCK - 1];
+    }
+    int64_t queue_us = esp_timer_get_time() - start;
+    vQueueDelete(queue);
+
+    double mbytes = (double)BENCH_FRAMES * PCM_RING_FRAME_BYTES / (1024 * 1024);
+    printf("pcm_ring bench: ring %.1f MB/s, queue %.1f MB/s (%d-frame blocks)\n",
+           mbytes * 1e6 / ring_us, mbytes * 1e6 / queue_us, BENCH_BLOCK);
+    TEST_ASSERT_EQUAL(checksum_queue, checksum_ring);
+}
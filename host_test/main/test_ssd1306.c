@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "ssd1306.h"
+
+/* Address byte + control byte per transaction, on top of the payload. */
+#define BUS_OVERHEAD 2
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t bytes;
+    uint8_t gddram[SSD1306_FB_SIZE];
+    uint8_t col_first, col_last, page_first, page_last;
+    size_t cursor;
+} fake_panel_t;
+
+/* Emulates horizontal addressing mode so the test can check what actually lands on the panel. */
+static esp_err_t fake_write(void *ctx, uint8_t control, const uint8_t *data, size_t len) {
+    fake_panel_t *panel = ctx;
+    panel->transactions++;
+    panel->bytes += len + BUS_OVERHEAD;
+    if (control == SSD1306_CONTROL_CMD) {
+        if (len == 6 && data[0] == 0x21 && data[3] == 0x22) {
+            panel->col_first = data[1];
+            panel->col_last = data[2];
+            panel->page_first = data[4];
+            panel->page_last = data[5];
+            panel->cursor = (size_t)panel->page_first * SSD1306_WIDTH + panel->col_first;
+        }
+        return ESP_OK;
+    }
+    for (size_t i = 0; i < len; i++) {
+        panel->gddram[panel->cursor] = data[i];
+        size_t page = panel->cursor / SSD1306_WIDTH;
+        size_t col = panel->cursor % SSD1306_WIDTH;
+        if (col == panel->col_last) {
+            col = panel->col_first;
+            page = page == panel->page_last ? panel->page_first : page + 1;
+        } else {
+            col++;
+        }
+        panel->cursor = page * SSD1306_WIDTH + col;
+    }
+    return ESP_OK;
+}
+
+static void reset_counters(fake_panel_t *panel) {
+    panel->transactions = 0;
+    panel->bytes = 0;
+}
+
+static void report(const char *what, const fake_panel_t *panel) {
+    printf("ssd1306 %-12s %4u transactions %5u bytes\n", what, (unsigned)panel->transactions, (unsigned)panel->bytes);
+}
+
+static ssd1306_t dev;
+static fake_panel_t panel;
+
+static void setup_panel(void) {
+    memset(&panel, 0xA5, sizeof(panel));
+    ssd1306_setup(&dev, fake_write, &panel);
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_init(&dev));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    reset_counters(&panel);
+}
+
+TEST_CASE("init pushes the whole frame in one burst", "[ssd1306]") {
+    memset(&panel, 0xA5, sizeof(panel));
+    ssd1306_setup(&dev, fake_write, &panel);
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_init(&dev));
+    reset_counters(&panel);
+    TEST_ASSERT_TRUE(ssd1306_is_dirty(&dev));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("init frame", &panel);
+    TEST_ASSERT_EQUAL(2, panel.transactions);
+    TEST_ASSERT_EQUAL(6 + SSD1306_FB_SIZE + 2 * BUS_OVERHEAD, panel.bytes);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0x00, panel.gddram, SSD1306_FB_SIZE);
+    TEST_ASSERT_FALSE(ssd1306_is_dirty(&dev));
+}
+
+TEST_CASE("clear of a blank screen sends nothing", "[ssd1306]") {
+    setup_panel();
+    ssd1306_clear(&dev);
+    TEST_ASSERT_FALSE(ssd1306_is_dirty(&dev));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("clear/blank", &panel);
+    TEST_ASSERT_EQUAL(0, panel.transactions);
+}
+
+TEST_CASE("one text line is a single window and burst", "[ssd1306]") {
+    setup_panel();
+    TEST_ASSERT_EQUAL(9, ssd1306_draw_text(&dev, 2, 0, "CONNECTED", 9));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("one line", &panel);
+    TEST_ASSERT_EQUAL(2, panel.transactions);
+    TEST_ASSERT_LESS_OR_EQUAL(6 + 9 * SSD1306_GLYPH_WIDTH + 2 * BUS_OVERHEAD, panel.bytes);
+    TEST_ASSERT_EQUAL_MEMORY(dev.fb, panel.gddram, SSD1306_FB_SIZE);
+
+    reset_counters(&panel);
+    ssd1306_clear(&dev);
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("clear line", &panel);
+    TEST_ASSERT_EQUAL(2, panel.transactions);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0x00, panel.gddram, SSD1306_FB_SIZE);
+}
+
+TEST_CASE("full screen update merges pages into one burst", "[ssd1306]") {
+    setup_panel();
+    uint8_t pattern[SSD1306_FB_SIZE];
+    for (size_t i = 0; i < sizeof(pattern); i++) {
+        pattern[i] = (uint8_t)(i * 7 + 1);
+    }
+    TEST_ASSERT_EQUAL(SSD1306_FB_SIZE, ssd1306_write(&dev, 0, 0, pattern, sizeof(pattern)));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("full screen", &panel);
+    TEST_ASSERT_EQUAL(2, panel.transactions);
+    TEST_ASSERT_EQUAL_MEMORY(pattern, panel.gddram, SSD1306_FB_SIZE);
+
+    reset_counters(&panel);
+    ssd1306_clear(&dev);
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("clear full", &panel);
+    TEST_ASSERT_EQUAL(2, panel.transactions);
+    TEST_ASSERT_EQUAL(6 + SSD1306_FB_SIZE + 2 * BUS_OVERHEAD, panel.bytes);
+    TEST_ASSERT_EACH_EQUAL_UINT8(0x00, panel.gddram, SSD1306_FB_SIZE);
+
+    /* The old per-byte path: 3 commands per page plus one transaction per data byte. */
+    printf("ssd1306 %-12s %4u transactions %5u bytes\n", "legacy clear",
+           (unsigned)(SSD1306_PAGES * 3 + SSD1306_FB_SIZE), (unsigned)((SSD1306_PAGES * 3 + SSD1306_FB_SIZE) * 3));
+}
+
+TEST_CASE("text wraps onto the next page", "[ssd1306]") {
+    setup_panel();
+    char text[24];
+    memset(text, 'W', sizeof(text));
+    TEST_ASSERT_EQUAL(sizeof(text), ssd1306_draw_text(&dev, 0, 0, text, sizeof(text)));
+    TEST_ASSERT_EQUAL(ESP_OK, ssd1306_flush(&dev));
+    report("wrapped", &panel);
+    TEST_ASSERT_EQUAL(4, panel.transactions);
+    TEST_ASSERT_EQUAL_MEMORY(dev.fb, panel.gddram, SSD1306_FB_SIZE);
+}
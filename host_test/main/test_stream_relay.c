@@ -0,0 +1,508 @@
+#include <malloc.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "unity.h"
+#include "esp_http_client.h"
+#include "esp_http_server.h"
+#include "esp_timer.h"
+#include "broadcast_ring.h"
+#include "stream_relay.h"
+
+#define RELAY_TEST_PORT 8073
+#define RELAY_TEST_URL "http://127.0.0.1:8073" STREAM_RELAY_URI
+#define RELAY_TEST_MAX_LISTENERS 32
+#define RELAY_TEST_BUFFER_SIZE (256 * 1024)
+/* Per listener: about 25 times a 320 kbit/s MP3 stream. */
+#define RELAY_TEST_RATE (1024 * 1024)
+#define RELAY_TEST_BLOCK 4096
+#define RELAY_TEST_WINDOW_MS 1500
+#define RELAY_TEST_DEADLINE_US (10 * 1000 * 1000)
+/* A listener keeps up when it receives this share of the feed rate. */
+#define RELAY_TEST_SUSTAINED_PERCENT 90
+/* Far below the feed rate: the ring laps a listener reading this much every 20 ms. */
+#define RELAY_TEST_TRICKLE 1024
+
+typedef struct {
+    httpd_handle_t server;
+    stream_relay_handle_t relay;
+    size_t relay_heap;          /* taken by stream_relay_start() */
+    atomic_bool stop;
+    atomic_bool stopped;
+} relay_fixture_t;
+
+typedef struct {
+    atomic_bool stop;
+    atomic_bool done;
+    int status;
+    uint64_t bytes;
+    uint32_t gaps;              /* breaks in the counter sequence */
+    int64_t elapsed_us;
+    char buf[1024];
+} listener_t;
+
+/* The feed is a little-endian uint32 counter, so a listener can spot any lost or repeated byte. */
+static void feeder_task(void *arg) {
+    relay_fixture_t *f = arg;
+    static uint32_t block[RELAY_TEST_BLOCK / sizeof(uint32_t)];
+    uint32_t word = 0;
+    uint64_t written = 0;
+    int64_t start = esp_timer_get_time();
+    while (!atomic_load(&f->stop)) {
+        while (written < (uint64_t)(esp_timer_get_time() - start) * RELAY_TEST_RATE / 1000000) {
+            for (int i = 0; i < RELAY_TEST_BLOCK / sizeof(uint32_t); i++) {
+                block[i] = word++;
+            }
+            stream_relay_write(f->relay, block, sizeof(block));
+            written += sizeof(block);
+        }
+        vTaskDelay(1);
+    }
+    atomic_store(&f->stopped, true);
+    vTaskDelete(NULL);
+}
+
+static void listener_task(void *arg) {
+    listener_t *l = arg;
+    esp_http_client_config_t config = { .url = RELAY_TEST_URL };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (esp_http_client_open(client, 0) == ESP_OK && esp_http_client_fetch_headers(client) >= 0) {
+        l->status = esp_http_client_get_status_code(client);
+    }
+    /* Listeners join at a block boundary, so words line up; a skip shows up as gaps. */
+    uint32_t word = 0;
+    uint32_t expected = 0;
+    int have = 0;
+    bool synced = false;
+    int64_t start = esp_timer_get_time();
+    while (l->status == 200 && !atomic_load(&l->stop)) {
+        int n = esp_http_client_read(client, l->buf, sizeof(l->buf));
+        if (n <= 0) {
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            word |= (uint32_t)(uint8_t)l->buf[i] << (8 * have);
+            if (++have == sizeof(word)) {
+                if (synced && word != expected) {
+                    l->gaps++;
+                }
+                synced = true;
+                expected = word + 1;
+                word = 0;
+                have = 0;
+            }
+        }
+        l->bytes += n;
+    }
+    l->elapsed_us = esp_timer_get_time() - start;
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    atomic_store(&l->done, true);
+    vTaskDelete(NULL);
+}
+
+/* Both arenas: the ring is big enough for glibc to mmap it. */
+static size_t heap_used(void) {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static void relay_fixture_start(relay_fixture_t *f, uint8_t max_clients) {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.server_port = RELAY_TEST_PORT;
+    config.ctrl_port = RELAY_TEST_PORT + 1;
+    /* Room for every listener plus the ones the relay turns away. */
+    config.max_open_sockets = RELAY_TEST_MAX_LISTENERS + 4;
+    TEST_ASSERT_EQUAL(ESP_OK, httpd_start(&f->server, &config));
+
+    stream_relay_config_t relay_config = STREAM_RELAY_DEFAULT_CONFIG();
+    relay_config.buffer_size = RELAY_TEST_BUFFER_SIZE;
+    relay_config.max_clients = max_clients;
+    size_t before = heap_used();
+    TEST_ASSERT_EQUAL(ESP_OK, stream_relay_start(f->server, &relay_config, &f->relay));
+    f->relay_heap = heap_used() - before;
+
+    atomic_store(&f->stop, false);
+    atomic_store(&f->stopped, false);
+    TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(feeder_task, "relay_feeder", 4096, f, 5, NULL));
+    /* Fill the ring past the backlog new listeners start from. */
+    vTaskDelay(pdMS_TO_TICKS(300));
+}
+
+static void relay_fixture_stop_feed(relay_fixture_t *f) {
+    atomic_store(&f->stop, true);
+    while (!atomic_load(&f->stopped)) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+static void relay_fixture_stop(relay_fixture_t *f) {
+    relay_fixture_stop_feed(f);
+    httpd_stop(f->server);
+    stream_relay_stop(f->relay);
+}
+
+static void start_listeners(listener_t *listeners, int n) {
+    for (int i = 0; i < n; i++) {
+        memset(&listeners[i], 0, sizeof(listeners[i]));
+        TEST_ASSERT_EQUAL(pdPASS, xTaskCreate(listener_task, "listener", 4096, &listeners[i], 5, NULL));
+    }
+}
+
+static bool wait_done(listener_t *listeners, int n) {
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < n; i++) {
+        while (!atomic_load(&listeners[i].done)) {
+            if (esp_timer_get_time() - start > RELAY_TEST_DEADLINE_US) {
+                return false;
+            }
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+    }
+    return true;
+}
+
+static bool stop_listeners(listener_t *listeners, int n) {
+    for (int i = 0; i < n; i++) {
+        atomic_store(&listeners[i].stop, true);
+    }
+    return wait_done(listeners, n);
+}
+
+/* Lowest per-listener rate in bytes/s, or 0 if any listener was refused or saw a gap. */
+static double report(const char *label, const listener_t *listeners, int n) {
+    double min = 0, max = 0, sum = 0;
+    uint32_t gaps = 0;
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        double rate = listeners[i].elapsed_us ? listeners[i].bytes * 1e6 / listeners[i].elapsed_us : 0;
+        min = i == 0 || rate < min ? rate : min;
+        max = rate > max ? rate : max;
+        sum += rate;
+        gaps += listeners[i].gaps;
+        ok = ok && listeners[i].status == 200 && listeners[i].gaps == 0;
+    }
+    printf("stream_relay %s %2d listeners: %.0f / %.0f / %.0f KB/s min/mean/max, %u gaps\n", label, n,
+           min / 1024, sum / n / 1024, max / 1024, (unsigned)gaps);
+    return ok ? min : 0;
+}
+
+/* Requests the stream on a raw socket with a small receive buffer, and reads nothing yet. */
+static int connect_raw(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    TEST_ASSERT_GREATER_OR_EQUAL(0, fd);
+    int rcvbuf = 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(RELAY_TEST_PORT) };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    TEST_ASSERT_EQUAL(0, connect(fd, (struct sockaddr *)&addr, sizeof(addr)));
+    const char request[] = "GET " STREAM_RELAY_URI " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    TEST_ASSERT_EQUAL(sizeof(request) - 1, send(fd, request, sizeof(request) - 1, 0));
+    return fd;
+}
+
+/*
+ * Loopback send buffers grow to megabytes, more than the ring holds. Caps
+ * the server's end of a connection so a listener that stops reading
+ * leaves the rest in the ring.
+ */
+static void limit_server_send_buffer(int fd) {
+    struct sockaddr_in local;
+    socklen_t len = sizeof(local);
+    TEST_ASSERT_EQUAL(0, getsockname(fd, (struct sockaddr *)&local, &len));
+    int size = 4096;
+    int found = 0;
+    for (int server_fd = 0; server_fd < 1024; server_fd++) {
+        struct sockaddr_in peer;
+        len = sizeof(peer);
+        if (server_fd != fd && getpeername(server_fd, (struct sockaddr *)&peer, &len) == 0 &&
+            peer.sin_port == local.sin_port) {
+            found += setsockopt(server_fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size)) == 0;
+        }
+    }
+    TEST_ASSERT_EQUAL(1, found);
+}
+
+static void wait_for_clients(stream_relay_handle_t relay, uint32_t clients) {
+    stream_relay_stats_t stats;
+    int64_t start = esp_timer_get_time();
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        stream_relay_get_stats(relay, &stats);
+    } while (stats.clients != clients && esp_timer_get_time() - start < RELAY_TEST_DEADLINE_US);
+    TEST_ASSERT_EQUAL(clients, stats.clients);
+}
+
+TEST_CASE("broadcast ring serves readers at their own positions", "[stream_relay]") {
+    static uint8_t storage[16];
+    uint8_t in[40];
+    const uint8_t *data;
+    broadcast_ring_t ring;
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, broadcast_ring_init(&ring, storage, 12));
+    TEST_ASSERT_EQUAL(ESP_OK, broadcast_ring_init(&ring, storage, sizeof(storage)));
+    for (int i = 0; i < sizeof(in); i++) {
+        in[i] = i;
+    }
+
+    broadcast_ring_write(&ring, in, 10);
+    TEST_ASSERT_EQUAL(10, broadcast_ring_peek(&ring, 0, &data, 100));
+    TEST_ASSERT_EQUAL(9, data[9]);
+    TEST_ASSERT_EQUAL(4, broadcast_ring_peek(&ring, 6, &data, 4));
+    TEST_ASSERT_EQUAL(0, broadcast_ring_peek(&ring, 10, &data, 100));
+
+    /* The second write wraps; a reader still at 0 has been overwritten, one at 4 has not. */
+    broadcast_ring_write(&ring, in + 10, 10);
+    TEST_ASSERT_EQUAL(20, broadcast_ring_head(&ring));
+    TEST_ASSERT_FALSE(broadcast_ring_intact(&ring, 0));
+    TEST_ASSERT_EQUAL(0, broadcast_ring_peek(&ring, 0, &data, 100));
+    TEST_ASSERT_TRUE(broadcast_ring_intact(&ring, 4));
+    TEST_ASSERT_EQUAL(12, broadcast_ring_peek(&ring, 4, &data, 100));
+    TEST_ASSERT_EQUAL(4, data[0]);
+    TEST_ASSERT_EQUAL(4, broadcast_ring_peek(&ring, 16, &data, 100));
+    TEST_ASSERT_EQUAL(16, data[0]);
+    TEST_ASSERT_EQUAL(19, data[3]);
+
+    /* Only the tail of an oversized write is kept. */
+    broadcast_ring_write(&ring, in, sizeof(in));
+    TEST_ASSERT_EQUAL(60, broadcast_ring_head(&ring));
+    TEST_ASSERT_FALSE(broadcast_ring_intact(&ring, 43));
+    TEST_ASSERT_TRUE(broadcast_ring_intact(&ring, 44));
+    TEST_ASSERT_EQUAL(4, broadcast_ring_peek(&ring, 44, &data, 100));
+    TEST_ASSERT_EQUAL(24, data[0]);
+    TEST_ASSERT_EQUAL(12, broadcast_ring_peek(&ring, 48, &data, 100));
+    TEST_ASSERT_EQUAL(28, data[0]);
+    TEST_ASSERT_EQUAL(39, data[11]);
+}
+
+/*
+ * Doubles the listeners until they stop keeping up with the feed; how far
+ * that gets depends on the host. The relay's own heap per listener is the
+ * difference between a relay with one slot and one with every slot.
+ */
+TEST_CASE("stream relay serves many listeners from one ring", "[stream_relay]") {
+    static listener_t listeners[RELAY_TEST_MAX_LISTENERS];
+    relay_fixture_t f;
+    relay_fixture_start(&f, 1);
+    size_t one_slot_heap = f.relay_heap;
+    relay_fixture_stop(&f);
+    relay_fixture_start(&f, RELAY_TEST_MAX_LISTENERS);
+    double heap_per_listener = ((double)f.relay_heap - one_slot_heap) / (RELAY_TEST_MAX_LISTENERS - 1);
+
+    const double sustained = RELAY_TEST_RATE * RELAY_TEST_SUSTAINED_PERCENT / 100.0;
+    int max_sustained = 0;
+    int tried = 0;
+    int expected_accepted = 0;
+    for (int n = 1; n <= RELAY_TEST_MAX_LISTENERS; n *= 2) {
+        start_listeners(listeners, n);
+        vTaskDelay(pdMS_TO_TICKS(RELAY_TEST_WINDOW_MS));
+        TEST_ASSERT_TRUE(stop_listeners(listeners, n));
+        for (int i = 0; i < n; i++) {
+            TEST_ASSERT_EQUAL(200, listeners[i].status);
+        }
+        bool kept_up = report("ramp", listeners, n) >= sustained;
+        tried = n;
+        expected_accepted += n;
+        wait_for_clients(f.relay, 0);
+        if (!kept_up) {
+            break;
+        }
+        max_sustained = n;
+    }
+
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(f.relay, &stats);
+    relay_fixture_stop(&f);
+    printf("stream_relay memory: %.1f bytes of heap per listener (%u in the slot), %u byte ring shared by all\n",
+           heap_per_listener, (unsigned)stats.client_bytes, RELAY_TEST_BUFFER_SIZE);
+    printf("stream_relay kept up with %d listeners at %d KB/s (tried up to %d), %u skips, %u dropped, "
+           "%llu KB in, %llu KB out\n", max_sustained, RELAY_TEST_RATE / 1024, tried, (unsigned)stats.skips,
+           (unsigned)stats.dropped, (unsigned long long)(stats.bytes_in / 1024),
+           (unsigned long long)(stats.bytes_out / 1024));
+
+    TEST_ASSERT_EQUAL(expected_accepted, stats.accepted);
+    TEST_ASSERT_EQUAL(0, stats.rejected);
+    TEST_ASSERT_EQUAL(tried, stats.peak_clients);
+}
+
+TEST_CASE("stream relay skips a lagging listener to the live edge", "[stream_relay]") {
+    static char buf[RELAY_TEST_TRICKLE];
+    relay_fixture_t f;
+    relay_fixture_start(&f, 2);
+    int fd = connect_raw();
+
+    /* Reads a trickle until the relay has skipped it and it is still being served after. */
+    stream_relay_stats_t stats;
+    uint64_t received = 0, after_skip = 0;
+    int64_t start = esp_timer_get_time();
+    do {
+        vTaskDelay(pdMS_TO_TICKS(20));
+        stream_relay_get_stats(f.relay, &stats);
+        int n = recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n > 0) {
+            received += n;
+            after_skip += stats.skips > 0 ? n : 0;
+        }
+    } while ((stats.skips == 0 || after_skip < sizeof(buf)) && esp_timer_get_time() - start < RELAY_TEST_DEADLINE_US);
+    int64_t skipped_us = esp_timer_get_time() - start;
+
+    close(fd);
+    relay_fixture_stop(&f);
+    printf("stream_relay lagging listener: %u skips after %lld ms, %llu bytes read, %llu since the skip\n",
+           (unsigned)stats.skips, (long long)(skipped_us / 1000), (unsigned long long)received,
+           (unsigned long long)after_skip);
+
+    TEST_ASSERT_GREATER_THAN(0, stats.skips);
+    TEST_ASSERT_GREATER_OR_EQUAL(sizeof(buf), after_skip);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+}
+
+TEST_CASE("stream relay forgives skips once a listener catches up", "[stream_relay]") {
+    static char buf[64 * 1024];
+    relay_fixture_t f;
+    relay_fixture_start(&f, 1);
+    int fd = connect_raw();
+    wait_for_clients(f.relay, 1);
+
+    /* Stalls until lapped, then reads flat out for a while; more laps than max_skips in all. */
+    const stream_relay_config_t config = STREAM_RELAY_DEFAULT_CONFIG();
+    stream_relay_stats_t stats = { 0 };
+    for (int round = 0; round <= config.max_skips + 1 && stats.dropped == 0; round++) {
+        uint32_t skips = stats.skips;
+        int64_t start = esp_timer_get_time();
+        do {
+            vTaskDelay(pdMS_TO_TICKS(10));
+            stream_relay_get_stats(f.relay, &stats);
+        } while (stats.skips == skips && esp_timer_get_time() - start < RELAY_TEST_DEADLINE_US);
+        start = esp_timer_get_time();
+        while (esp_timer_get_time() - start < 300 * 1000) {
+            if (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) <= 0) {
+                vTaskDelay(1);
+            }
+        }
+        stream_relay_get_stats(f.relay, &stats);
+    }
+
+    close(fd);
+    relay_fixture_stop(&f);
+    printf("stream_relay catching up: %u skips, %u dropped\n", (unsigned)stats.skips, (unsigned)stats.dropped);
+
+    TEST_ASSERT_GREATER_THAN(config.max_skips, stats.skips);
+    TEST_ASSERT_EQUAL(0, stats.dropped);
+}
+
+TEST_CASE("stream relay drains and ends the stream on finish", "[stream_relay]") {
+    static uint8_t response[RELAY_TEST_BUFFER_SIZE * 2];
+    relay_fixture_t f;
+    relay_fixture_start(&f, 1);
+    int fd = connect_raw();
+    wait_for_clients(f.relay, 1);
+    limit_server_send_buffer(fd);
+
+    /* The listener's socket is full when the feed ends, so no write is left to push the rest. */
+    vTaskDelay(pdMS_TO_TICKS(100));
+    relay_fixture_stop_feed(&f);
+    stream_relay_finish(f.relay);
+    vTaskDelay(pdMS_TO_TICKS(100));
+
+    size_t len = 0;
+    int n = 1;
+    int64_t start = esp_timer_get_time();
+    while (n != 0 && len < sizeof(response) && esp_timer_get_time() - start < RELAY_TEST_DEADLINE_US) {
+        n = recv(fd, response + len, sizeof(response) - len, MSG_DONTWAIT);
+        if (n > 0) {
+            len += n;
+        } else if (n < 0) {
+            vTaskDelay(1);
+        }
+    }
+    close(fd);
+    /* Closed by the relay once the last chunk was out. */
+    TEST_ASSERT_EQUAL(0, n);
+
+    /* Unchunks in place, then checks the counter runs on to the last word written. */
+    uint8_t *body = response;
+    while (body + 4 <= response + len && memcmp(body, "\r\n\r\n", 4) != 0) {
+        body++;
+    }
+    TEST_ASSERT_TRUE(body + 4 <= response + len);
+    body += 4;
+    const uint8_t *end = response + len;
+    size_t payload = 0, chunk;
+    do {
+        char *next;
+        chunk = strtoul((const char *)body, &next, 16);
+        TEST_ASSERT_EQUAL_MEMORY("\r\n", next, 2);
+        body = (uint8_t *)next + 2;
+        TEST_ASSERT_LESS_OR_EQUAL(end - body, chunk + 2);
+        memmove(response + payload, body, chunk);
+        payload += chunk;
+        body += chunk + 2;
+    } while (chunk > 0);
+    TEST_ASSERT_TRUE(body == end);
+
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(f.relay, &stats);
+    wait_for_clients(f.relay, 0);
+    relay_fixture_stop(&f);
+    printf("stream_relay finish: %zu bytes drained after the feed ended, %llu in\n", payload,
+           (unsigned long long)stats.bytes_in);
+
+    TEST_ASSERT_EQUAL(0, payload % sizeof(uint32_t));
+    uint32_t words = payload / sizeof(uint32_t);
+    uint32_t first;
+    memcpy(&first, response, sizeof(first));
+    for (uint32_t i = 1; i < words; i++) {
+        uint32_t word;
+        memcpy(&word, response + i * sizeof(word), sizeof(word));
+        TEST_ASSERT_EQUAL_UINT32(first + i, word);
+    }
+    TEST_ASSERT_EQUAL_UINT32(stats.bytes_in / sizeof(uint32_t) - 1, first + words - 1);
+    TEST_ASSERT_EQUAL(payload, stats.bytes_out);
+    TEST_ASSERT_EQUAL(0, stats.skips);
+}
+
+TEST_CASE("stream relay drops a stalled listener and keeps the rest going", "[stream_relay]") {
+    static listener_t listeners[4];
+    relay_fixture_t f;
+    relay_fixture_start(&f, 4);
+    start_listeners(listeners, 3);
+
+    /* Never reads: the server's socket buffer fills and stays full. */
+    int fd = connect_raw();
+    wait_for_clients(f.relay, 4);
+    /* Every slot is taken: one more is turned away with a 503. */
+    start_listeners(&listeners[3], 1);
+    TEST_ASSERT_TRUE(wait_done(&listeners[3], 1));
+    TEST_ASSERT_EQUAL(503, listeners[3].status);
+
+    stream_relay_stats_t stats;
+    int64_t start = esp_timer_get_time();
+    do {
+        vTaskDelay(pdMS_TO_TICKS(10));
+        stream_relay_get_stats(f.relay, &stats);
+    } while (stats.dropped == 0 && esp_timer_get_time() - start < RELAY_TEST_DEADLINE_US);
+    int64_t dropped_us = esp_timer_get_time() - start;
+
+    vTaskDelay(pdMS_TO_TICKS(RELAY_TEST_WINDOW_MS));
+    TEST_ASSERT_TRUE(stop_listeners(listeners, 3));
+    report("stalled", listeners, 3);
+    close(fd);
+    relay_fixture_stop(&f);
+    printf("stream_relay stalled listener dropped after %lld ms, %u skips\n", (long long)(dropped_us / 1000),
+           (unsigned)stats.skips);
+
+    TEST_ASSERT_EQUAL(1, stats.dropped);
+    TEST_ASSERT_EQUAL(4, stats.accepted);
+    TEST_ASSERT_EQUAL(1, stats.rejected);
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL(200, listeners[i].status);
+        TEST_ASSERT_GREATER_THAN(0, listeners[i].bytes);
+        TEST_ASSERT_EQUAL(0, listeners[i].gaps);
+    }
+}
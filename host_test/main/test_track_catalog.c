@@ -0,0 +1,358 @@
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#include "unity.h"
+#include "esp_timer.h"
+#include "track_catalog.h"
+
+/* Written by the fixture in pytest_host_test.py with tools/gen_track_catalog.py. */
+#define TRACK_GEN_DIR "/tmp/track_catalog_gen"
+
+#define FRAME_BYTES 417         /* MPEG-1 Layer III, 128 kbit/s, 44.1 kHz, no padding */
+#define FILE_FRAMES 3
+#define TRACKS_PER_DIR 100
+#define PAGE 16
+
+static const uint8_t frame_header[4] = { 0xFF, 0xFB, 0x90, 0x64 };
+
+static size_t put_be32(uint8_t *p, uint32_t v, bool syncsafe) {
+    int shift = syncsafe ? 7 : 8;
+    for (int i = 0; i < 4; i++) {
+        p[i] = (v >> (shift * (3 - i))) & (syncsafe ? 0x7F : 0xFF);
+    }
+    return 4;
+}
+
+static size_t id3_text_frame(uint8_t *p, int version, const char *id, uint8_t encoding, const void *text, size_t len) {
+    size_t pos = 0;
+    if (version == 2) {
+        memcpy(p, id, 3);
+        p[3] = 0;
+        p[4] = (len + 1) >> 8;
+        p[5] = (len + 1) & 0xFF;
+        pos = 6;
+    } else {
+        memcpy(p, id, 4);
+        put_be32(p + 4, len + 1, version == 4);
+        p[8] = p[9] = 0;
+        pos = 10;
+    }
+    p[pos++] = encoding;
+    memcpy(p + pos, text, len);
+    return pos + len;
+}
+
+/* Untagged when version is 0; a Xing header announces `frames` frames when non-zero. */
+static void write_track(const char *path, int version, uint8_t encoding, const void *title, size_t title_len,
+                        const char *artist, uint32_t frames) {
+    static uint8_t buf[1024 + FILE_FRAMES * FRAME_BYTES];
+    size_t len = 0;
+    if (version) {
+        size_t body = 10;
+        body += id3_text_frame(buf + body, version, version == 2 ? "TT2" : "TIT2", encoding, title, title_len);
+        body += id3_text_frame(buf + body, version, version == 2 ? "TP1" : "TPE1", 0, artist, strlen(artist));
+        memset(buf + body, 0, 32); /* padding */
+        body += 32;
+        memcpy(buf, "ID3", 3);
+        buf[3] = version;
+        buf[4] = 0;
+        buf[5] = 0;
+        put_be32(buf + 6, body - 10, true);
+        len = body;
+    }
+    for (int i = 0; i < FILE_FRAMES; i++) {
+        memset(buf + len, 0, FRAME_BYTES);
+        memcpy(buf + len, frame_header, sizeof(frame_header));
+        if (i == 0 && frames) {
+            memcpy(buf + len + 36, "Xing", 4);
+            put_be32(buf + len + 40, 1, false);
+            put_be32(buf + len + 44, frames, false);
+        }
+        len += FRAME_BYTES;
+    }
+    FILE *f = fopen(path, "wb");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(len, fwrite(buf, 1, len, f));
+    fclose(f);
+}
+
+static void write_library_track(const char *dir, int i, const char *title_prefix) {
+    char path[TRACK_CATALOG_PATH_MAX];
+    char title[64];
+    snprintf(path, sizeof(path), "%s/artist_%03d/track_%04d.mp3", dir, i / TRACKS_PER_DIR, i);
+    int n = snprintf(title, sizeof(title), "%s %d", title_prefix, i);
+    write_track(path, 3, 0, title, n, "Test Artist", 1000 + i % 100);
+}
+
+static void build_library(const char *dir, int tracks) {
+    char path[TRACK_CATALOG_PATH_MAX];
+    TEST_ASSERT_EQUAL(0, mkdir(dir, 0755));
+    for (int i = 0; i < tracks; i++) {
+        if (i % TRACKS_PER_DIR == 0) {
+            snprintf(path, sizeof(path), "%s/artist_%03d", dir, i / TRACKS_PER_DIR);
+            TEST_ASSERT_EQUAL(0, mkdir(path, 0755));
+        }
+        write_library_track(dir, i, "Track");
+    }
+}
+
+static void remove_tree(const char *dir) {
+    DIR *d = opendir(dir);
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *entry;
+    char path[TRACK_CATALOG_PATH_MAX];
+    while ((entry = readdir(d)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) >= (int)sizeof(path)) {
+            continue;
+        }
+        if (remove(path) != 0) {
+            remove_tree(path);
+        }
+    }
+    closedir(d);
+    remove(dir);
+}
+
+TEST_CASE("track probe reads ID3v2 text in every encoding", "[track_catalog]") {
+    char dir[] = "/tmp/track_probe_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(dir));
+    char path[TRACK_CATALOG_PATH_MAX];
+    track_info_t info;
+    struct stat st;
+
+    /* ISO-8859-1 "Café" */
+    snprintf(path, sizeof(path), "%s/latin1.mp3", dir);
+    write_track(path, 3, 0, "Caf\xE9", 4, "Artist One", 1000);
+    stat(path, &st);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_probe(path, st.st_size, &info));
+    TEST_ASSERT_EQUAL_STRING("Caf\xC3\xA9", info.title);
+    TEST_ASSERT_EQUAL_STRING("Artist One", info.artist);
+    TEST_ASSERT_EQUAL(1000ull * 1152 * 1000 / 44100, info.duration_ms);
+    TEST_ASSERT_EQUAL(st.st_size - FILE_FRAMES * FRAME_BYTES, info.audio_offset);
+
+    /* UTF-16 with a little-endian BOM: "Ωx" */
+    snprintf(path, sizeof(path), "%s/utf16.mp3", dir);
+    write_track(path, 3, 1, "\xFF\xFE\xA9\x03x\x00", 6, "B", 0);
+    stat(path, &st);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_probe(path, st.st_size, &info));
+    TEST_ASSERT_EQUAL_STRING("\xCE\xA9x", info.title);
+    /* No Xing header: duration from the frame bitrate. */
+    TEST_ASSERT_EQUAL(FILE_FRAMES * FRAME_BYTES * 8 / 128, info.duration_ms);
+    TEST_ASSERT_EQUAL(128, info.bitrate_kbps);
+
+    snprintf(path, sizeof(path), "%s/utf8.mp3", dir);
+    write_track(path, 4, 3, "\xE2\x99\xAA tune  ", 10, "C", 0);
+    stat(path, &st);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_probe(path, st.st_size, &info));
+    TEST_ASSERT_EQUAL_STRING("\xE2\x99\xAA tune", info.title);
+
+    snprintf(path, sizeof(path), "%s/v22.mp3", dir);
+    write_track(path, 2, 0, "Old tag", 7, "D", 0);
+    stat(path, &st);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_probe(path, st.st_size, &info));
+    TEST_ASSERT_EQUAL_STRING("Old tag", info.title);
+    TEST_ASSERT_EQUAL_STRING("D", info.artist);
+
+    snprintf(path, sizeof(path), "%s/No Tag Here.mp3", dir);
+    write_track(path, 0, 0, NULL, 0, NULL, 0);
+    stat(path, &st);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_probe(path, st.st_size, &info));
+    TEST_ASSERT_EQUAL_STRING("No Tag Here", info.title);
+    TEST_ASSERT_EQUAL_STRING("", info.artist);
+    TEST_ASSERT_EQUAL(0, info.audio_offset);
+
+    remove_tree(dir);
+}
+
+TEST_CASE("track catalog load and incremental rescan timing", "[track_catalog]") {
+    static const int sizes[] = { 100, 1000, 10000 };
+    static track_info_t page[PAGE];
+    char base[] = "/tmp/track_catalog_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(base));
+
+    printf("track_catalog %6s %10s %10s %10s %12s %10s\n", "files", "full ms", "open us", "browse ms", "rescan ms",
+           "changed ms");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int tracks = sizes[s];
+        char dir[64], catalog[64], path[TRACK_CATALOG_PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/lib_%d", base, tracks);
+        snprintf(catalog, sizeof(catalog), "%s/tracks_%d.cat", base, tracks);
+        build_library(dir, tracks);
+
+        track_catalog_scan_stats_t stats;
+        int64_t start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+        int64_t full_us = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(tracks, stats.tracks);
+        TEST_ASSERT_EQUAL(tracks, stats.parsed);
+
+        /* Boot-time load is the header only; browsing reads every page once. */
+        track_catalog_t cat;
+        start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_open(&cat, catalog));
+        int64_t open_us = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(tracks, cat.count);
+        uint32_t seen = 0, got;
+        start = esp_timer_get_time();
+        do {
+            TEST_ASSERT_EQUAL(ESP_OK, track_catalog_read(&cat, seen, page, PAGE, &got));
+            for (uint32_t i = 0; i < got; i++) {
+                TEST_ASSERT_EQUAL_STRING("Test Artist", page[i].artist);
+                TEST_ASSERT_EQUAL(0, strncmp(page[i].path, dir, strlen(dir)));
+            }
+            seen += got;
+        } while (got > 0);
+        int64_t browse_us = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(tracks, seen);
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_read(&cat, tracks - 1, page, PAGE, &got));
+        TEST_ASSERT_EQUAL(1, got);
+        track_catalog_close(&cat);
+
+        start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+        int64_t rescan_us = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(tracks, stats.unchanged);
+        TEST_ASSERT_EQUAL(0, stats.parsed);
+
+        /* Retag 1%, delete one file and add one. */
+        int changed = tracks / 100;
+        for (int i = 0; i < changed; i++) {
+            int victim = i * 100 + 7;
+            write_library_track(dir, victim, "Retagged");
+            snprintf(path, sizeof(path), "%s/artist_%03d/track_%04d.mp3", dir, victim / TRACKS_PER_DIR, victim);
+            struct utimbuf times = { .actime = 2000000000, .modtime = 2000000000 };
+            TEST_ASSERT_EQUAL(0, utime(path, &times));
+        }
+        snprintf(path, sizeof(path), "%s/artist_000/track_0003.mp3", dir);
+        TEST_ASSERT_EQUAL(0, remove(path));
+        snprintf(path, sizeof(path), "%s/artist_000/extra.mp3", dir);
+        write_track(path, 3, 0, "Extra", 5, "Test Artist", 10);
+
+        start = esp_timer_get_time();
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+        int64_t changed_us = esp_timer_get_time() - start;
+        TEST_ASSERT_EQUAL(tracks, stats.tracks);
+        TEST_ASSERT_EQUAL(changed + 1, stats.parsed);
+        TEST_ASSERT_EQUAL(tracks - changed - 1, stats.unchanged);
+        TEST_ASSERT_EQUAL(1, stats.removed);
+
+        bool retagged = false;
+        TEST_ASSERT_EQUAL(ESP_OK, track_catalog_open(&cat, catalog));
+        for (seen = 0; !retagged && track_catalog_read(&cat, seen, page, PAGE, &got) == ESP_OK && got > 0; seen += got) {
+            for (uint32_t i = 0; i < got; i++) {
+                retagged |= strcmp(page[i].title, "Retagged 7") == 0;
+            }
+        }
+        track_catalog_close(&cat);
+        TEST_ASSERT_TRUE(retagged);
+
+        printf("track_catalog %6d %10.1f %10lld %10.1f %12.1f %10.1f\n", tracks, full_us / 1000.0,
+               (long long)open_us, browse_us / 1000.0, rescan_us / 1000.0, changed_us / 1000.0);
+    }
+    printf("track_catalog RAM: %u bytes per open catalog, %u bytes per %d-track page\n",
+           (unsigned)sizeof(track_catalog_t), (unsigned)sizeof(page), PAGE);
+    remove_tree(base);
+}
+
+TEST_CASE("track catalog rescan survives a run of deleted files", "[track_catalog]") {
+    char base[] = "/tmp/track_catalog_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(base));
+    char dir[64], catalog[64], path[TRACK_CATALOG_PATH_MAX];
+    snprintf(dir, sizeof(dir), "%s/lib", base);
+    snprintf(catalog, sizeof(catalog), "%s/tracks.cat", base);
+    build_library(dir, 2 * TRACKS_PER_DIR);
+    track_catalog_scan_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+
+    /* More consecutive deletions than fit in any lookahead, spanning a directory. */
+    for (int i = 60; i < 140; i++) {
+        snprintf(path, sizeof(path), "%s/artist_%03d/track_%04d.mp3", dir, i / TRACKS_PER_DIR, i);
+        TEST_ASSERT_EQUAL(0, remove(path));
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+    TEST_ASSERT_EQUAL(120, stats.tracks);
+    TEST_ASSERT_EQUAL(120, stats.unchanged);
+    TEST_ASSERT_EQUAL(0, stats.parsed);
+    TEST_ASSERT_EQUAL(80, stats.removed);
+
+    /* Everything from the last directory on. */
+    snprintf(path, sizeof(path), "%s/artist_001", dir);
+    remove_tree(path);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+    TEST_ASSERT_EQUAL(60, stats.unchanged);
+    TEST_ASSERT_EQUAL(60, stats.removed);
+    remove_tree(base);
+}
+
+TEST_CASE("track catalog rejects records longer than track_info_t", "[track_catalog]") {
+    char base[] = "/tmp/track_catalog_XXXXXX";
+    TEST_ASSERT_NOT_NULL(mkdtemp(base));
+    char dir[64], catalog[64];
+    snprintf(dir, sizeof(dir), "%s/lib", base);
+    snprintf(catalog, sizeof(catalog), "%s/tracks.cat", base);
+    build_library(dir, 3);
+    track_catalog_scan_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+
+    /* The first record's title_len (header 32 bytes, then the length at record offset 27). */
+    FILE *f = fopen(catalog, "r+b");
+    TEST_ASSERT_NOT_NULL(f);
+    TEST_ASSERT_EQUAL(0, fseek(f, 32 + 27, SEEK_SET));
+    TEST_ASSERT_EQUAL(TRACK_CATALOG_TEXT_MAX, fputc(TRACK_CATALOG_TEXT_MAX, f));
+    fclose(f);
+
+    track_catalog_t cat;
+    track_info_t info[3];
+    uint32_t got;
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_open(&cat, catalog));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, track_catalog_read(&cat, 0, info, 3, &got));
+    TEST_ASSERT_EQUAL(0, got);
+    track_catalog_close(&cat);
+
+    /* A rescan does not copy the bad record; it parses that file again. */
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(catalog, dir, &stats));
+    TEST_ASSERT_EQUAL(1, stats.parsed);
+    TEST_ASSERT_EQUAL(2, stats.unchanged);
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_open(&cat, catalog));
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_read(&cat, 0, info, 3, &got));
+    TEST_ASSERT_EQUAL(3, got);
+    TEST_ASSERT_EQUAL_STRING("Track 0", info[0].title);
+    track_catalog_close(&cat);
+    remove_tree(base);
+}
+
+TEST_CASE("host generator output matches an on-device rescan", "[track_catalog]") {
+    track_catalog_scan_stats_t stats;
+    TEST_ASSERT_EQUAL(ESP_OK, track_catalog_rescan(TRACK_GEN_DIR "/device.cat", TRACK_GEN_DIR "/music", &stats));
+    TEST_ASSERT_GREATER_THAN(0, stats.tracks);
+
+    FILE *a = fopen(TRACK_GEN_DIR "/tracks.cat", "rb");
+    FILE *b = fopen(TRACK_GEN_DIR "/device.cat", "rb");
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    long offset = 0;
+    int ca, cb;
+    do {
+        ca = fgetc(a);
+        cb = fgetc(b);
+        if (ca != cb) {
+            break;
+        }
+        offset++;
+    } while (ca != EOF);
+    fclose(a);
+    fclose(b);
+    printf("track_catalog generator: %u tracks, catalogs identical up to byte %ld\n", (unsigned)stats.tracks, offset);
+    TEST_ASSERT_EQUAL(ca, cb);
+    remove(TRACK_GEN_DIR "/device.cat");
+}
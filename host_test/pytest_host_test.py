@@ -0,0 +1,128 @@
+import os
+import re
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import threading
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from typing import Iterator
+
+import pytest
+from pytest_embedded_idf.dut import IdfDut
+
+# Must match test_http_stream.c
+STREAM_PORT = 8070
+STREAM_SIZE = 4 * 1024 * 1024
+STREAM_DROP_AT = 1024 * 1024
+# Must match test_track_catalog.c
+TRACK_GEN_DIR = '/tmp/track_catalog_gen'
+GEN_TRACK_CATALOG = os.path.join(os.path.dirname(__file__), '..', 'tools', 'gen_track_catalog.py')
+
+
+def stream_pattern(size: int) -> bytes:
+    return bytes((i * 7 + (i >> 10)) & 0xFF for i in range(size))
+
+
+class StreamHandler(BaseHTTPRequestHandler):
+    """Stand-in for the music server: Range support; /drop.bin cuts every fresh download short."""
+
+    protocol_version = 'HTTP/1.1'
+
+    def do_GET(self) -> None:
+        if self.path not in ('/stream.bin', '/drop.bin'):
+            self.send_error(404)
+            return
+        data = self.server.data  # type: ignore[attr-defined]
+        start = 0
+        match = re.fullmatch(r'bytes=(\d+)-', self.headers.get('Range', ''))
+        if match:
+            start = int(match.group(1))
+            self.send_response(206)
+            self.send_header('Content-Range', f'bytes {start}-{len(data) - 1}/{len(data)}')
+        else:
+            self.send_response(200)
+        self.send_header('Accept-Ranges', 'bytes')
+        self.send_header('Content-Length', str(len(data) - start))
+        self.end_headers()
+
+        body = memoryview(data)[start:]
+        if start == 0 and self.path == '/drop.bin':
+            self.wfile.write(body[:STREAM_DROP_AT])
+            self.wfile.flush()
+            self.connection.shutdown(socket.SHUT_RDWR)
+            self.close_connection = True
+            return
+        self.wfile.write(body)
+
+    def log_message(self, format: str, *args: object) -> None:
+        pass
+
+
+@pytest.fixture(scope='module')
+def stream_server() -> Iterator[None]:
+    server = ThreadingHTTPServer(('127.0.0.1', STREAM_PORT), StreamHandler)
+    server.data = stream_pattern(STREAM_SIZE)  # type: ignore[attr-defined]
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    yield
+    server.shutdown()
+    server.server_close()
+
+
+def id3_tag(version: int, frames: list) -> bytes:
+    body = b''
+    for frame_id, data in frames:
+        if version == 2:
+            body += frame_id + len(data).to_bytes(3, 'big') + data
+        elif version == 3:
+            body += frame_id + struct.pack('>IH', len(data), 0) + data
+        else:
+            size = sum(((len(data) >> (7 * i)) & 0x7F) << (8 * i) for i in range(4))
+            body += frame_id + struct.pack('>IH', size, 0) + data
+    body += bytes(16)
+    size = sum(((len(body) >> (7 * i)) & 0x7F) << (8 * i) for i in range(4))
+    return b'ID3' + bytes([version, 0, 0]) + struct.pack('>I', size) + body
+
+
+def mpeg_frames(header: bytes, frame_bytes: int, count: int, vbr: bytes = b'', vbr_at: int = 36) -> bytes:
+    first = bytearray(header + bytes(frame_bytes - 4))
+    first[vbr_at:vbr_at + len(vbr)] = vbr
+    return bytes(first) + (header + bytes(frame_bytes - 4)) * (count - 1)
+
+
+@pytest.fixture(scope='module')
+def track_library() -> Iterator[None]:
+    """A small library with every tag flavour the probe handles, catalogued by the host generator."""
+    shutil.rmtree(TRACK_GEN_DIR, ignore_errors=True)
+    music = os.path.join(TRACK_GEN_DIR, 'music')
+    os.makedirs(os.path.join(music, 'Artist A', 'Album', 'CD1', 'deep', 'too deep'))
+    cbr = mpeg_frames(b'\xff\xfb\x90\x64', 417, 20)
+    xing = mpeg_frames(b'\xff\xfb\x90\x64', 417, 20, b'Xing' + struct.pack('>II', 1, 9000))
+    vbri = mpeg_frames(b'\xff\xfb\x90\x64', 417, 20, b'VBRI' + bytes(10) + struct.pack('>I', 4321))
+    mpeg2 = mpeg_frames(b'\xff\xf3\x40\xc4', 104, 30)  # 22.05 kHz mono 32 kbit/s
+    files = {
+        'one.mp3': id3_tag(3, [(b'TIT2', b'\x00One  '), (b'TPE1', b'\x00Caf\xe9')]) + xing,
+        'TWO.MP3': id3_tag(4, [(b'TIT2', b'\x03\xe2\x99\xaa Two'), (b'TPE1', b'\x02\x00B')]) + vbri,
+        'untagged song.mp3': b'\x00' * 100 + cbr,
+        'notes.txt': b'not audio',
+        '.hidden.mp3': cbr,
+        'Artist A/old.mp3': id3_tag(2, [(b'TT2', b'\x00Old'), (b'TP1', b'\x01\xff\xfe\x3d\xd8\x00\xde')]) + cbr,
+        'Artist A/Album/long.mp3': id3_tag(3, [(b'TIT2', b'\x00' + b'L' * 300)]) + mpeg2,
+        'Artist A/Album/CD1/deep/leaf.mp3': cbr,
+        'Artist A/Album/CD1/deep/too deep/skipped.mp3': cbr,
+        'Artist A/Album/broken.mp3': id3_tag(3, [(b'TIT2', b'\x00Broken')]) + bytes(5000),
+    }
+    for name, data in files.items():
+        with open(os.path.join(music, name), 'wb') as f:
+            f.write(data)
+    subprocess.run([sys.executable, GEN_TRACK_CATALOG, music, os.path.join(TRACK_GEN_DIR, 'tracks.cat')], check=True)
+    yield
+    shutil.rmtree(TRACK_GEN_DIR, ignore_errors=True)
+
+
+@pytest.mark.linux
+@pytest.mark.host_test
+def test_host_test(stream_server: None, track_library: None, dut: IdfDut) -> None:
+    dut.expect(r'\d+ Tests 0 Failures 0 Ignored', timeout=120)
@@ -1,14 +1,24 @@
+#include <stdatomic.h>
 #include <stdio.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "driver/i2c.h"
 #include <string.h>
-#include "esp_http_client.h"
 #include "esp_netif.h"
+#include "ssd1306.h"
+#include "display_task.h"
+#include "http_stream.h"
+#include "audio_output.h"
+#include "mp3_decoder.h"
+#include "track_library.h"
+#include "boot.h"
+#include "metrics.h"
+#include "web_server.h"
 
 #define WIFI_SSID "WINDTRE-14B490"
 #define WIFI_PASS "7cx472b8u5u57k8r"
@@ -17,22 +27,19 @@
 #define I2C_MASTER_SCL_IO 22
 #define I2C_MASTER_SDA_IO 21
 #define I2C_MASTER_NUM I2C_NUM_0
-#define I2C_MASTER_FREQ_HZ 100000
-
-static const uint8_t font5x7[][5] = {
-    {0x7E,0x11,0x11,0x7E,0x00}, {0x7F,0x49,0x49,0x36,0x00}, {0x3E,0x41,0x41,0x22,0x00},
-    {0x7F,0x41,0x41,0x3E,0x00}, {0x7F,0x49,0x49,0x41,0x00}, {0x7F,0x09,0x09,0x01,0x00},
-    {0x3E,0x41,0x51,0x32,0x00}, {0x7F,0x08,0x08,0x7F,0x00}, {0x41,0x7F,0x41,0x00,0x00},
-    {0x20,0x40,0x41,0x3F,0x00}, {0x7F,0x08,0x14,0x63,0x00}, {0x7F,0x40,0x40,0x40,0x00},
-    {0x7F,0x02,0x04,0x02,0x7F}, {0x7F,0x06,0x18,0x7F,0x00}, {0x3E,0x41,0x41,0x3E,0x00},
-    {0x7F,0x09,0x09,0x06,0x00}, {0x3E,0x41,0x61,0x7E,0x00}, {0x7F,0x09,0x19,0x66,0x00},
-    {0x46,0x49,0x49,0x31,0x00}, {0x01,0x7F,0x01,0x01,0x00}, {0x3F,0x40,0x40,0x3F,0x00},
-    {0x1F,0x20,0x40,0x20,0x1F}, {0x3F,0x40,0x38,0x40,0x3F}, {0x63,0x14,0x08,0x14,0x63},
-    {0x07,0x08,0x70,0x08,0x07}, {0x61,0x51,0x49,0x45,0x43}
-};
+#define I2C_MASTER_FREQ_HZ CONFIG_OLED_I2C_FREQ_HZ
 
 static const char *TAG = "MAIN";
 
+static ssd1306_t oled;
+static metrics_counter_t *wifi_connects;
+static metrics_counter_t *wifi_disconnects;
+static metrics_counter_t *wifi_got_ip;
+static metrics_counter_t *http_bytes;
+static metrics_histogram_t *decode_hist;
+/* Worst time spent handling one chunk of stream data, excluding the wait for it. */
+static atomic_uint_least32_t http_cb_max_us;
+
 void i2c_master_init() {
     i2c_config_t conf = {
         .mode = I2C_MODE_MASTER,
@@ -46,82 +53,33 @@ void i2c_master_init() {
     i2c_driver_install(I2C_MASTER_NUM, conf.mode, 0, 0, 0);
 }
 
-void oled_send_cmd(uint8_t cmd) {
+static esp_err_t oled_i2c_write(void *ctx, uint8_t control, const uint8_t *data, size_t len) {
     i2c_cmd_handle_t handle = i2c_cmd_link_create();
     i2c_master_start(handle);
     i2c_master_write_byte(handle, (OLED_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(handle, 0x00, true);
-    i2c_master_write_byte(handle, cmd, true);
+    i2c_master_write_byte(handle, control, true);
+    i2c_master_write(handle, data, len, true);
     i2c_master_stop(handle);
-    i2c_master_cmd_begin(I2C_MASTER_NUM, handle, 1000 / portTICK_PERIOD_MS);
+    esp_err_t err = i2c_master_cmd_begin(I2C_MASTER_NUM, handle, 1000 / portTICK_PERIOD_MS);
     i2c_cmd_link_delete(handle);
-}
-
-void oled_send_data(uint8_t data) {
-    i2c_cmd_handle_t handle = i2c_cmd_link_create();
-    i2c_master_start(handle);
-    i2c_master_write_byte(handle, (OLED_ADDR << 1) | I2C_MASTER_WRITE, true);
-    i2c_master_write_byte(handle, 0x40, true);
-    i2c_master_write_byte(handle, data, true);
-    i2c_master_stop(handle);
-    i2c_master_cmd_begin(I2C_MASTER_NUM, handle, 1000 / portTICK_PERIOD_MS);
-    i2c_cmd_link_delete(handle);
-}
-
-void oled_clear() {
-    for (uint8_t page = 0; page < 8; page++) {
-        oled_send_cmd(0xB0 + page);
-        oled_send_cmd(0x00);
-        oled_send_cmd(0x10);
-        for (uint8_t i = 0; i < 128; i++) {
-            oled_send_data(0x00);
-        }
-    }
-}
-
-void oled_write_char(char c) {
-    if (c >= 'A' && c <= 'Z') {
-        uint8_t *bitmap = (uint8_t *)font5x7[c - 'A'];
-        for (int i = 0; i < 5; i++) {
-            oled_send_data(bitmap[i]);
-        }
-        oled_send_data(0x00);
-    }
+    return err;
 }
 
 void oled_write_connected_text() {
-    oled_clear();
-    oled_send_cmd(0xB2);
-    oled_send_cmd(0x00);
-    oled_send_cmd(0x10);
     const char *text = "CONNECTED";
-    while (*text) {
-        oled_write_char(*text);
-        text++;
-    }
+    display_show_text(2, text, strlen(text));
 }
 
 void oled_init() {
-    vTaskDelay(100 / portTICK_PERIOD_MS);
-    oled_send_cmd(0xAE);
-    oled_send_cmd(0x20); oled_send_cmd(0x00);
-    oled_send_cmd(0xB0);
-    oled_send_cmd(0xC8);
-    oled_send_cmd(0x00);
-    oled_send_cmd(0x10);
-    oled_send_cmd(0x40);
-    oled_send_cmd(0x81); oled_send_cmd(0xFF);
-    oled_send_cmd(0xA1);
-    oled_send_cmd(0xA6);
-    oled_send_cmd(0xA8); oled_send_cmd(0x3F);
-    oled_send_cmd(0xA4);
-    oled_send_cmd(0xD3); oled_send_cmd(0x00);
-    oled_send_cmd(0xD5); oled_send_cmd(0xF0);
-    oled_send_cmd(0xD9); oled_send_cmd(0x22);
-    oled_send_cmd(0xDA); oled_send_cmd(0x12);
-    oled_send_cmd(0xDB); oled_send_cmd(0x20);
-    oled_send_cmd(0x8D); oled_send_cmd(0x14);
-    oled_send_cmd(0xAF);
+    ssd1306_setup(&oled, oled_i2c_write, NULL);
+}
+
+void set_dns_server() {
+    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    esp_netif_dns_info_t dns;
+    dns.ip.u_addr.ip4.addr = ipaddr_addr("8.8.8.8");
+    dns.ip.type = IPADDR_TYPE_V4;
+    esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
 }
 
 static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data) {
@@ -129,10 +87,20 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
         ESP_LOGI(TAG, "Wi-Fi Connected!");
+        boot_mark(BOOT_STAGE_WIFI_CONNECTED);
+        metrics_counter_add(wifi_connects, 1);
         oled_write_connected_text();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
         ESP_LOGI(TAG, "Wi-Fi Disconnected. Reconnecting...");
+        boot_set_network_up(false);
+        metrics_counter_add(wifi_disconnects, 1);
         esp_wifi_connect();
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        /* DHCP has just installed its DNS server; override it before anyone resolves a name. */
+        set_dns_server();
+        boot_mark(BOOT_STAGE_GOT_IP);
+        metrics_counter_add(wifi_got_ip, 1);
+        boot_set_network_up(true);
     }
 }
 
@@ -145,6 +113,7 @@ void wifi_init_sta(void) {
     esp_wifi_init(&cfg);
 
     esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL, NULL);
+    esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL, NULL);
 
     wifi_config_t wifi_config = {
         .sta = {
@@ -157,63 +126,205 @@ void wifi_init_sta(void) {
     esp_wifi_start();
 }
 
-void set_dns_server() {
-    esp_netif_t *netif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
-    esp_netif_dns_info_t dns;
-    dns.ip.u_addr.ip4.addr = ipaddr_addr("8.8.8.8");
-    dns.ip.type = IPADDR_TYPE_V4;
-    esp_netif_set_dns_info(netif, ESP_NETIF_DNS_MAIN, &dns);
+static int stream_source_read(void *ctx, void *buf, size_t len) {
+    int n = http_stream_read(ctx, buf, len, portMAX_DELAY);
+    if (n > 0) {
+        int64_t start = esp_timer_get_time();
+        metrics_counter_add(http_bytes, n);
+        web_server_relay(buf, n);
+        uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+        if (elapsed > atomic_load_explicit(&http_cb_max_us, memory_order_relaxed)) {
+            atomic_store_explicit(&http_cb_max_us, elapsed, memory_order_relaxed);
+        }
+    }
+    return n;
 }
 
-esp_err_t _http_event_handler(esp_http_client_event_t *evt) {
-    switch (evt->event_id) {
-        case HTTP_EVENT_ON_DATA:
-            printf("%.*s", evt->data_len, (char*)evt->data);
-            oled_clear();
-            oled_send_cmd(0xB0);
-            oled_send_cmd(0x00);
-            oled_send_cmd(0x10);
-            for (int i = 0; i < evt->data_len; i++) {
-                char c = ((char*)evt->data)[i];
-                if (c >= 'A' && c <= 'Z') {
-                    oled_write_char(c);
-                }
-            }
-            break;
-        default:
-            break;
+static esp_err_t stream_source_seek(void *ctx, uint32_t offset) {
+    return http_stream_seek(ctx, offset);
+}
+
+/*
+ * The stream's frame index is kept on SPIFFS next to the track catalog.
+ * The file starts with the URL it indexes, so a new CONFIG_STREAM_URL
+ * never picks up the old stream's offsets.
+ */
+static void stream_index_load(mp3_index_t *index) {
+    FILE *f = fopen(CONFIG_STREAM_INDEX_PATH, "rb");
+    if (f == NULL) {
+        return;
+    }
+    char url[sizeof(CONFIG_STREAM_URL) + 1];
+    esp_err_t err = ESP_ERR_INVALID_VERSION;
+    if (fgets(url, sizeof(url), f) != NULL && strcmp(url, CONFIG_STREAM_URL "\n") == 0) {
+        err = mp3_index_load(index, f);
     }
-    return ESP_OK;
+    fclose(f);
+    if (err != ESP_OK) {
+        mp3_index_free(index);
+        ESP_LOGW(TAG, "Ignoring %s: %s", CONFIG_STREAM_INDEX_PATH, esp_err_to_name(err));
+        return;
+    }
+    ESP_LOGI(TAG, "Index of %lu frames loaded from %s", index->frames, CONFIG_STREAM_INDEX_PATH);
 }
 
-void http_get_task(void *pvParameters) {
-    ESP_LOGI(TAG, "Starting HTTP GET task...");
+static void stream_index_save(const mp3_index_t *index) {
+    char tmp_path[sizeof(CONFIG_STREAM_INDEX_PATH) + 4];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", CONFIG_STREAM_INDEX_PATH);
+    FILE *f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        ESP_LOGW(TAG, "Failed to create %s", tmp_path);
+        return;
+    }
+    bool ok = fprintf(f, "%s\n", CONFIG_STREAM_URL) > 0 && mp3_index_save(index, f) == ESP_OK;
+    ok = fclose(f) == 0 && ok;
+    if (ok) {
+        /* rename() will not replace an existing file on SPIFFS or FAT. */
+        remove(CONFIG_STREAM_INDEX_PATH);
+        ok = rename(tmp_path, CONFIG_STREAM_INDEX_PATH) == 0;
+    }
+    if (!ok) {
+        remove(tmp_path);
+        ESP_LOGW(TAG, "Failed to save the index to %s", CONFIG_STREAM_INDEX_PATH);
+    }
+}
+
+void stream_task(void *pvParameters) {
+    boot_wait_for_network(portMAX_DELAY);
+    ESP_LOGI(TAG, "Streaming %s", CONFIG_STREAM_URL);
+
+    http_stream_config_t config = HTTP_STREAM_DEFAULT_CONFIG();
+    config.url = CONFIG_STREAM_URL;
+    config.buffer_size = CONFIG_STREAM_BUFFER_SIZE;
+    config.low_watermark = CONFIG_STREAM_LOW_WATERMARK;
+    config.high_watermark = CONFIG_STREAM_HIGH_WATERMARK;
+    http_stream_handle_t stream;
+    if (http_stream_start(&config, &stream) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start stream");
+        vTaskDelete(NULL);
+    }
+    mp3_decoder_t *decoder;
+    if (mp3_decoder_create(&decoder) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create MP3 decoder");
+        http_stream_stop(stream);
+        vTaskDelete(NULL);
+    }
 
-    esp_http_client_config_t config = {
-        .url = "http://192.168.1.7:8080/test.txt",
-        .event_handler = _http_event_handler,
-        .disable_auto_redirect = true,
-        .skip_cert_common_name_check = true,
-        .transport_type = HTTP_TRANSPORT_OVER_TCP,
+    bool cached;
+    mp3_index_t *index = mp3_index_cache_get(CONFIG_STREAM_URL, &cached);
+    if (!cached) {
+        stream_index_load(index);
+    }
+    uint32_t indexed = index->frames;
+    mp3_source_t source = {
+        .read = stream_source_read,
+        .seek = stream_source_seek,
+        .ctx = stream,
     };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_perform(client);
-    esp_http_client_cleanup(client);
+    mp3_decoder_open(decoder, &source, index);
+    boot_mark(BOOT_STAGE_STREAM_OPEN);
+    display_show_text(0, "PLAYING", 7);
+
+    /* Each frame is decoded straight into its slot in the PCM ring. */
+    uint32_t frames = 0;
+    mp3_frame_info_t info;
+    while (true) {
+        int16_t *pcm = audio_output_reserve(MP3_DECODER_MAX_FRAMES, portMAX_DELAY);
+        int64_t start = esp_timer_get_time();
+        if (mp3_decoder_decode(decoder, pcm, &info) != ESP_OK) {
+            break;
+        }
+        metrics_histogram_record(decode_hist, (uint32_t)(esp_timer_get_time() - start));
+        if (frames++ == 0) {
+            ESP_LOGI(TAG, "MP3 %lu Hz, %u channel(s), %u kbit/s", info.sample_rate, info.channels, info.bitrate_kbps);
+            esp_err_t err = audio_output_set_source_rate(info.sample_rate);
+            if (err != ESP_OK) {
+                /* Rather than play at the wrong pitch. */
+                ESP_LOGE(TAG, "Cannot resample to the I2S rate %d: %s", CONFIG_AUDIO_SAMPLE_RATE, esp_err_to_name(err));
+                break;
+            }
+        }
+        audio_output_commit(info.frames);
+        if (frames == 1) {
+            boot_mark(BOOT_STAGE_FIRST_AUDIO);
+            boot_log_timeline();
+        }
+    }
+
+    web_server_relay_finish();
+    if (index->frames > indexed) {
+        stream_index_save(index);
+    }
+
+    mp3_decoder_stats_t mp3_stats;
+    mp3_decoder_get_stats(decoder, &mp3_stats);
+    mp3_decoder_destroy(decoder);
+    ESP_LOGI(TAG, "MP3: %lu frames, %lu errors, %lu resyncs, worst decode %lu us, index %lu frames / %lu ms",
+             mp3_stats.frames_decoded, mp3_stats.decode_errors, mp3_stats.resyncs, mp3_stats.max_decode_us,
+             index->frames, mp3_index_duration_ms(index));
+
+    http_stream_stats_t stream_stats;
+    http_stream_get_stats(stream, &stream_stats);
+    http_stream_stop(stream);
+    ESP_LOGI(TAG, "Stream: %llu bytes, %lu underruns, %lu reconnects, worst recovery %lu ms",
+             stream_stats.bytes_received, stream_stats.underruns, stream_stats.reconnects,
+             stream_stats.max_recovery_ms);
+    ESP_LOGI(TAG, "Data callback worst case %lu us", (unsigned long)atomic_load(&http_cb_max_us));
+
+    display_stats_t stats;
+    display_get_stats(&stats);
+    ESP_LOGI(TAG, "Display: %lu requested, %lu rendered, %lu coalesced, %lu skipped, worst render %lu us",
+             stats.frames_requested, stats.frames_rendered, stats.frames_coalesced,
+             stats.frames_skipped, stats.max_render_us);
     vTaskDelete(NULL);
 }
 
+static int64_t boot_stage_ms(void *ctx) {
+    return boot_stage_us((boot_stage_t)(intptr_t)ctx) / 1000;
+}
+
+static int64_t http_cb_max(void *ctx) {
+    return atomic_load_explicit(&http_cb_max_us, memory_order_relaxed);
+}
+
+static void metrics_init(void) {
+    wifi_connects = metrics_counter_register("wifi_connects");
+    wifi_disconnects = metrics_counter_register("wifi_disconnects");
+    wifi_got_ip = metrics_counter_register("wifi_got_ip");
+    http_bytes = metrics_counter_register("http_bytes");
+    decode_hist = metrics_histogram_register("mp3_decode_us");
+    metrics_gauge_register("http_cb_max_us", http_cb_max, NULL);
+    metrics_gauge_register("boot_got_ip_ms", boot_stage_ms, (void *)BOOT_STAGE_GOT_IP);
+    metrics_gauge_register("boot_first_audio_ms", boot_stage_ms, (void *)BOOT_STAGE_FIRST_AUDIO);
+}
+
+/*
+ * Nothing here waits: the OLED comes up in the display task, the catalog in
+ * the library task, and the stream task blocks until DHCP has given us an
+ * address. Only NVS has to be ready before Wi-Fi starts.
+ */
 void app_main(void) {
+    ESP_ERROR_CHECK(boot_init());
+    metrics_init();
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         nvs_flash_erase();
         nvs_flash_init();
     }
+    boot_mark(BOOT_STAGE_NVS);
 
     i2c_master_init();
     oled_init();
-    oled_clear();
+    /* Playback does not need the panel: carry on without it. */
+    ret = display_task_start(&oled);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Display task not started: %s", esp_err_to_name(ret));
+    }
     wifi_init_sta();
-    vTaskDelay(5000 / portTICK_PERIOD_MS);
-    set_dns_server();
-    xTaskCreate(&http_get_task, "http_get_task", 8192, NULL, 5, NULL);
+    boot_mark(BOOT_STAGE_WIFI_START);
+    ESP_ERROR_CHECK(audio_output_start());
+    boot_mark(BOOT_STAGE_AUDIO);
+    track_library_start();
+    web_server_start();
+    xTaskCreate(&stream_task, "stream_task", 6144, NULL, 5, NULL);
 }
@@ -0,0 +1,273 @@
+#include "audio_output.h"
+
+#include <stdatomic.h>
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "driver/i2s_std.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "metrics.h"
+#include "pcm_biquad.h"
+#include "pcm_resampler.h"
+#include "pcm_volume.h"
+
+#define AUDIO_OUTPUT_BLOCK_FRAMES 256
+#define AUDIO_OUTPUT_STACK 3072
+#define AUDIO_OUTPUT_PRIORITY 10
+#define AUDIO_OUTPUT_CORE 1
+#define AUDIO_VOLUME_RAMP_FRAMES (CONFIG_AUDIO_SAMPLE_RATE / 50)
+#define AUDIO_VOLUME_RANGE_DB 50
+#define AUDIO_EQ_BASS_HZ 150
+#define AUDIO_EQ_TREBLE_HZ 6000
+#define AUDIO_EQ_SHELF_Q 0.707f
+#define AUDIO_EQ_MAX_BANDS 2
+#define AUDIO_RATE_SWITCHES 4
+
+/* A source rate change, made at the first frame committed at the new rate. */
+typedef struct {
+    pcm_resampler_t *resampler;     /* NULL at the I2S rate */
+    uint32_t at;                    /* committed_frames when the change was requested */
+} rate_switch_t;
+
+static const char *TAG = "AUDIO_OUT";
+
+static pcm_ring_t ring;
+static i2s_chan_handle_t tx_chan;
+static TaskHandle_t output_task;
+static TaskHandle_t volatile waiting_producer;
+static metrics_histogram_t *write_hist;
+static metrics_histogram_t *dsp_hist;
+
+/* Output task only. */
+static pcm_volume_t volume;
+static int applied_volume = 100;
+static pcm_biquad_t eq[AUDIO_EQ_MAX_BANDS];
+static int eq_bands;
+static pcm_resampler_t *resampler;
+static uint32_t played_frames;
+static int16_t resampled[AUDIO_OUTPUT_BLOCK_FRAMES * PCM_RING_CHANNELS];
+
+/* Handed over from other tasks, picked up at the start of the next block. */
+static atomic_int requested_volume = 100;
+static QueueHandle_t rate_switches;
+
+/* Producer side. */
+static uint32_t source_rate = CONFIG_AUDIO_SAMPLE_RATE;
+static uint32_t committed_frames;
+
+static int64_t ring_fill(void *ctx) {
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&ring, &stats);
+    return stats.fill;
+}
+
+static int64_t ring_underruns(void *ctx) {
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&ring, &stats);
+    return stats.underruns;
+}
+
+static int64_t ring_producer_waits(void *ctx) {
+    pcm_ring_stats_t stats;
+    pcm_ring_get_stats(&ring, &stats);
+    return stats.producer_waits;
+}
+
+static int32_t volume_gain(int percent) {
+    if (percent <= 0) {
+        return 0;
+    }
+    return pcm_volume_gain_from_db((percent - 100) * AUDIO_VOLUME_RANGE_DB / 100.0f);
+}
+
+/*
+ * Installs the resampler for a rate change once playback has reached its
+ * first frame, and returns how many frames may be taken before the next
+ * change. Frames already in the ring keep the rate they were committed at.
+ */
+static size_t apply_rate_switches(void) {
+    rate_switch_t sw;
+    while (xQueuePeek(rate_switches, &sw, 0) == pdTRUE) {
+        uint32_t ahead = sw.at - played_frames;
+        if (ahead != 0) {
+            return ahead < AUDIO_OUTPUT_BLOCK_FRAMES ? ahead : AUDIO_OUTPUT_BLOCK_FRAMES;
+        }
+        xQueueReceive(rate_switches, &sw, 0);
+        pcm_resampler_destroy(resampler);
+        resampler = sw.resampler;
+    }
+    return AUDIO_OUTPUT_BLOCK_FRAMES;
+}
+
+static void apply_volume(void) {
+    int percent = atomic_load_explicit(&requested_volume, memory_order_relaxed);
+    if (percent != applied_volume) {
+        pcm_volume_set(&volume, volume_gain(percent), AUDIO_VOLUME_RAMP_FRAMES);
+        applied_volume = percent;
+    }
+}
+
+/*
+ * Volume and EQ run in place on the ring span; only a resampled block goes
+ * through a buffer of its own, since its length differs from the input's.
+ */
+static void audio_output_task(void *pvParameters) {
+    while (true) {
+        int16_t *frames;
+        size_t n = pcm_ring_read_acquire(&ring, &frames, apply_rate_switches());
+        if (n == 0) {
+            /* DMA keeps playing silence (auto_clear) until the producer commits again. */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+        apply_volume();
+        int64_t start = esp_timer_get_time();
+        int16_t *block = frames;
+        size_t consumed = n;
+        if (resampler != NULL) {
+            n = pcm_resampler_process(resampler, frames, &consumed, resampled, AUDIO_OUTPUT_BLOCK_FRAMES);
+            block = resampled;
+        }
+        for (int i = 0; i < eq_bands; i++) {
+            pcm_biquad_process(&eq[i], block, n);
+        }
+        pcm_volume_process(&volume, block, n);
+        metrics_histogram_record(dsp_hist, (uint32_t)(esp_timer_get_time() - start));
+
+        size_t written = 0;
+        if (n > 0) {
+            start = esp_timer_get_time();
+            i2s_channel_write(tx_chan, block, n * PCM_RING_FRAME_BYTES, &written, portMAX_DELAY);
+            metrics_histogram_record(write_hist, (uint32_t)(esp_timer_get_time() - start));
+        }
+        size_t released = resampler != NULL ? consumed : written / PCM_RING_FRAME_BYTES;
+        pcm_ring_read_release(&ring, released);
+        played_frames += released;
+
+        TaskHandle_t producer = waiting_producer;
+        if (producer != NULL) {
+            xTaskNotifyGive(producer);
+        }
+    }
+}
+
+static esp_err_t i2s_init(void) {
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+    chan_cfg.auto_clear = true;
+    esp_err_t err = i2s_new_channel(&chan_cfg, &tx_chan, NULL);
+    if (err != ESP_OK) {
+        return err;
+    }
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(CONFIG_AUDIO_SAMPLE_RATE),
+        .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_16BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = CONFIG_I2S_BCK_IO,
+            .ws = CONFIG_I2S_WS_IO,
+            .dout = CONFIG_I2S_DOUT_IO,
+            .din = I2S_GPIO_UNUSED,
+        },
+    };
+    err = i2s_channel_init_std_mode(tx_chan, &std_cfg);
+    if (err != ESP_OK) {
+        return err;
+    }
+    return i2s_channel_enable(tx_chan);
+}
+
+static void eq_init(void) {
+    if (CONFIG_AUDIO_EQ_BASS_DB != 0 &&
+        pcm_biquad_design(&eq[eq_bands], PCM_BIQUAD_LOW_SHELF, CONFIG_AUDIO_SAMPLE_RATE, AUDIO_EQ_BASS_HZ,
+                          AUDIO_EQ_SHELF_Q, CONFIG_AUDIO_EQ_BASS_DB) == ESP_OK) {
+        eq_bands++;
+    }
+    if (CONFIG_AUDIO_EQ_TREBLE_DB != 0 &&
+        pcm_biquad_design(&eq[eq_bands], PCM_BIQUAD_HIGH_SHELF, CONFIG_AUDIO_SAMPLE_RATE, AUDIO_EQ_TREBLE_HZ,
+                          AUDIO_EQ_SHELF_Q, CONFIG_AUDIO_EQ_TREBLE_DB) == ESP_OK) {
+        eq_bands++;
+    }
+}
+
+esp_err_t audio_output_start(void) {
+    size_t bytes = CONFIG_AUDIO_PCM_RING_FRAMES * PCM_RING_FRAME_BYTES;
+    int16_t *storage = heap_caps_aligned_alloc(PCM_RING_STORAGE_ALIGN, bytes, MALLOC_CAP_DMA);
+    if (storage == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ESP_ERROR_CHECK(pcm_ring_init(&ring, storage, CONFIG_AUDIO_PCM_RING_FRAMES));
+    rate_switches = xQueueCreate(AUDIO_RATE_SWITCHES, sizeof(rate_switch_t));
+    if (rate_switches == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    pcm_volume_init(&volume, PCM_VOLUME_UNITY);
+    eq_init();
+    write_hist = metrics_histogram_register("i2s_write_us");
+    dsp_hist = metrics_histogram_register("pcm_dsp_us");
+    metrics_gauge_register("pcm_ring_fill_frames", ring_fill, NULL);
+    metrics_gauge_register("pcm_ring_underruns", ring_underruns, NULL);
+    metrics_gauge_register("pcm_ring_producer_waits", ring_producer_waits, NULL);
+
+    esp_err_t err = i2s_init();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "I2S init failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (xTaskCreatePinnedToCore(&audio_output_task, "audio_output", AUDIO_OUTPUT_STACK, NULL,
+                                AUDIO_OUTPUT_PRIORITY, &output_task, AUDIO_OUTPUT_CORE) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+int16_t *audio_output_reserve(size_t frames, TickType_t timeout) {
+    TickType_t start = xTaskGetTickCount();
+    int16_t *slot = NULL;
+    waiting_producer = xTaskGetCurrentTaskHandle();
+    while (!pcm_ring_write_reserve_block(&ring, &slot, frames)) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            slot = NULL;
+            break;
+        }
+        ulTaskNotifyTake(pdTRUE, timeout - elapsed);
+    }
+    waiting_producer = NULL;
+    return slot;
+}
+
+void audio_output_commit(size_t frames) {
+    pcm_ring_write_commit(&ring, frames);
+    committed_frames += frames;
+    xTaskNotifyGive(output_task);
+}
+
+esp_err_t audio_output_set_source_rate(uint32_t sample_rate) {
+    if (sample_rate == source_rate) {
+        return ESP_OK;
+    }
+    pcm_resampler_t *rs = NULL;
+    if (sample_rate != CONFIG_AUDIO_SAMPLE_RATE) {
+        esp_err_t err = pcm_resampler_create(sample_rate, CONFIG_AUDIO_SAMPLE_RATE, &rs);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    rate_switch_t sw = { .resampler = rs, .at = committed_frames };
+    if (xQueueSend(rate_switches, &sw, 0) != pdTRUE) {
+        pcm_resampler_destroy(rs);
+        return ESP_ERR_INVALID_STATE;
+    }
+    source_rate = sample_rate;
+    ESP_LOGI(TAG, "Source %lu Hz, output %d Hz", sample_rate, CONFIG_AUDIO_SAMPLE_RATE);
+    return ESP_OK;
+}
+
+void audio_output_set_volume(int percent) {
+    atomic_store_explicit(&requested_volume, percent < 0 ? 0 : percent > 100 ? 100 : percent, memory_order_relaxed);
+}
+
+void audio_output_get_stats(pcm_ring_stats_t *stats) {
+    pcm_ring_get_stats(&ring, stats);
+}
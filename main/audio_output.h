@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "pcm_ring.h"
+
+/* Allocates the PCM ring and starts the I2S writer task. */
+esp_err_t audio_output_start(void);
+
+/*
+ * Producer side of the PCM ring: waits up to timeout for a contiguous slot
+ * of `frames` stereo frames, to be decoded into directly and then committed.
+ */
+int16_t *audio_output_reserve(size_t frames, TickType_t timeout);
+void audio_output_commit(size_t frames);
+
+/*
+ * Frames committed from now on are at sample_rate and are resampled to
+ * CONFIG_AUDIO_SAMPLE_RATE, so the I2S clock never changes. Frames already
+ * in the ring still play at the old rate; the output switches when it
+ * reaches the first new one. Producer side; call before committing the
+ * first frame at a new rate. ESP_ERR_INVALID_STATE when four changes are
+ * already waiting for playback to reach them.
+ */
+esp_err_t audio_output_set_source_rate(uint32_t sample_rate);
+
+/* 0-100, on a 50 dB scale; the change is ramped in over 20 ms. Any task. */
+void audio_output_set_volume(int percent);
+
+void audio_output_get_stats(pcm_ring_stats_t *stats);
@@ -0,0 +1,88 @@
+#include "boot.h"
+
+#include "freertos/event_groups.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#define BOOT_NETWORK_UP_BIT (1 << 0)
+
+static const char *TAG = "BOOT";
+
+static const char *const stage_names[BOOT_STAGE_COUNT] = {
+    [BOOT_STAGE_APP_MAIN] = "app_main",
+    [BOOT_STAGE_NVS] = "nvs",
+    [BOOT_STAGE_AUDIO] = "i2s",
+    [BOOT_STAGE_WIFI_START] = "wifi start",
+    [BOOT_STAGE_DISPLAY] = "oled",
+    [BOOT_STAGE_WIFI_CONNECTED] = "wifi connected",
+    [BOOT_STAGE_GOT_IP] = "got ip",
+    [BOOT_STAGE_STREAM_OPEN] = "stream open",
+    [BOOT_STAGE_FIRST_AUDIO] = "first audio",
+    [BOOT_STAGE_CATALOG] = "catalog",
+};
+
+static EventGroupHandle_t events;
+static int64_t stage_us[BOOT_STAGE_COUNT];
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t boot_init(void) {
+    events = xEventGroupCreate();
+    if (events == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    boot_mark(BOOT_STAGE_APP_MAIN);
+    return ESP_OK;
+}
+
+void boot_mark(boot_stage_t stage) {
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&lock);
+    if (stage_us[stage] == 0) {
+        stage_us[stage] = now;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+int64_t boot_stage_us(boot_stage_t stage) {
+    portENTER_CRITICAL(&lock);
+    int64_t us = stage_us[stage];
+    portEXIT_CRITICAL(&lock);
+    return us;
+}
+
+void boot_set_network_up(bool up) {
+    if (up) {
+        xEventGroupSetBits(events, BOOT_NETWORK_UP_BIT);
+    } else {
+        xEventGroupClearBits(events, BOOT_NETWORK_UP_BIT);
+    }
+}
+
+bool boot_wait_for_network(TickType_t timeout) {
+    return xEventGroupWaitBits(events, BOOT_NETWORK_UP_BIT, pdFALSE, pdTRUE, timeout) & BOOT_NETWORK_UP_BIT;
+}
+
+void boot_log_timeline(void) {
+    int64_t times[BOOT_STAGE_COUNT];
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+        times[i] = boot_stage_us(i);
+    }
+    int64_t prev = 0;
+    bool done[BOOT_STAGE_COUNT] = { 0 };
+    /* Few stages: a selection pass per line is enough. */
+    for (int line = 0; line < BOOT_STAGE_COUNT; line++) {
+        int next = -1;
+        for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+            if (!done[i] && times[i] != 0 && (next < 0 || times[i] < times[next])) {
+                next = i;
+            }
+        }
+        if (next < 0) {
+            break;
+        }
+        done[next] = true;
+        ESP_LOGI(TAG, "%-14s %6lld ms  (+%lld ms)", stage_names[next], times[next] / 1000,
+                 (times[next] - prev) / 1000);
+        prev = times[next];
+    }
+}
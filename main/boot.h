@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+typedef enum {
+    BOOT_STAGE_APP_MAIN,
+    BOOT_STAGE_NVS,
+    BOOT_STAGE_AUDIO,
+    BOOT_STAGE_WIFI_START,
+    BOOT_STAGE_DISPLAY,
+    BOOT_STAGE_WIFI_CONNECTED,
+    BOOT_STAGE_GOT_IP,
+    BOOT_STAGE_STREAM_OPEN,
+    BOOT_STAGE_FIRST_AUDIO,
+    BOOT_STAGE_CATALOG,
+    BOOT_STAGE_COUNT,
+} boot_stage_t;
+
+/* Creates the boot event group and marks BOOT_STAGE_APP_MAIN. Call first. */
+esp_err_t boot_init(void);
+
+/* Records when a stage was first reached, in microseconds since power-on. Later calls are ignored. */
+void boot_mark(boot_stage_t stage);
+
+/* 0 until the stage is reached. */
+int64_t boot_stage_us(boot_stage_t stage);
+
+/* Driven by the IP_EVENT handler; network users block in boot_wait_for_network() until it is up. */
+void boot_set_network_up(bool up);
+bool boot_wait_for_network(TickType_t timeout);
+
+/* Logs every stage reached so far in time order, with the gap from the previous one. */
+void boot_log_timeline(void);
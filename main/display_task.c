@@ -0,0 +1,133 @@
+#include "display_task.h"
+
+#include <stdatomic.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "boot.h"
+#include "metrics.h"
+
+#define DISPLAY_TASK_STACK 3072
+#define DISPLAY_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define DISPLAY_FRAME_PERIOD pdMS_TO_TICKS(1000 / CONFIG_DISPLAY_MAX_FPS)
+#define DISPLAY_POWER_UP_DELAY pdMS_TO_TICKS(100)
+
+typedef struct {
+    uint32_t seq;
+    uint8_t page;
+    uint8_t len;
+    char text[DISPLAY_TEXT_MAX];
+} display_frame_t;
+
+static const char *TAG = "DISPLAY";
+
+static ssd1306_t *panel;
+static QueueHandle_t mailbox;
+static SemaphoreHandle_t post_lock;
+static bool running;            /* set once by display_task_start(); posts are dropped until then */
+static atomic_uint_least32_t next_seq;
+static display_stats_t stats;
+static metrics_histogram_t *render_hist;
+
+static bool same_content(const display_frame_t *a, const display_frame_t *b) {
+    return a->page == b->page && a->len == b->len && memcmp(a->text, b->text, a->len) == 0;
+}
+
+static void render(const display_frame_t *frame) {
+    int64_t start = esp_timer_get_time();
+    ssd1306_clear(panel);
+    ssd1306_draw_text(panel, frame->page, 0, frame->text, frame->len);
+    if (ssd1306_flush(panel) != ESP_OK) {
+        ESP_LOGW(TAG, "Flush failed");
+    }
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+    if (elapsed > stats.max_render_us) {
+        stats.max_render_us = elapsed;
+    }
+    metrics_histogram_record(render_hist, elapsed);
+    stats.frames_rendered++;
+}
+
+static void display_task(void *pvParameters) {
+    display_frame_t frame;
+    display_frame_t shown = { 0 };
+    uint32_t last_seq = 0;
+
+    /* The panel comes up here so its power-up delay overlaps the rest of boot; text posted meanwhile waits. */
+    vTaskDelay(DISPLAY_POWER_UP_DELAY);
+    if (ssd1306_init(panel) != ESP_OK) {
+        ESP_LOGW(TAG, "SSD1306 init failed");
+    }
+    ssd1306_flush(panel);
+    boot_mark(BOOT_STAGE_DISPLAY);
+    TickType_t last_render = xTaskGetTickCount() - DISPLAY_FRAME_PERIOD;
+    while (true) {
+        xQueueReceive(mailbox, &frame, portMAX_DELAY);
+
+        /* Hold off until the next frame slot, then pick up whatever arrived in the meantime. */
+        TickType_t since = xTaskGetTickCount() - last_render;
+        if (since < DISPLAY_FRAME_PERIOD) {
+            vTaskDelay(DISPLAY_FRAME_PERIOD - since);
+            xQueueReceive(mailbox, &frame, 0);
+        }
+
+        if (frame.seq <= last_seq) {
+            continue;
+        }
+        stats.frames_coalesced += frame.seq - last_seq - 1;
+        last_seq = frame.seq;
+
+        if (same_content(&frame, &shown)) {
+            stats.frames_skipped++;
+            continue;
+        }
+        render(&frame);
+        shown = frame;
+        last_render = xTaskGetTickCount();
+    }
+}
+
+esp_err_t display_task_start(ssd1306_t *oled) {
+    panel = oled;
+    render_hist = metrics_histogram_register("display_render_us");
+    mailbox = xQueueCreate(1, sizeof(display_frame_t));
+    post_lock = xSemaphoreCreateMutex();
+    if (mailbox == NULL || post_lock == NULL ||
+        xTaskCreate(&display_task, "display_task", DISPLAY_TASK_STACK, NULL, DISPLAY_TASK_PRIORITY, NULL) != pdPASS) {
+        if (mailbox != NULL) {
+            vQueueDelete(mailbox);
+        }
+        if (post_lock != NULL) {
+            vSemaphoreDelete(post_lock);
+        }
+        return ESP_ERR_NO_MEM;
+    }
+    running = true;
+    return ESP_OK;
+}
+
+void display_show_text(uint8_t page, const char *text, size_t len) {
+    if (!running) {
+        return;
+    }
+    display_frame_t frame = { .page = page };
+    for (size_t i = 0; i < len && frame.len < DISPLAY_TEXT_MAX; i++) {
+        if (text[i] >= 'A' && text[i] <= 'Z') {
+            frame.text[frame.len++] = text[i];
+        }
+    }
+    /* Numbering and posting together, so a newer frame is never overwritten by an older one. */
+    xSemaphoreTake(post_lock, portMAX_DELAY);
+    frame.seq = atomic_fetch_add(&next_seq, 1) + 1;
+    xQueueOverwrite(mailbox, &frame);
+    xSemaphoreGive(post_lock);
+}
+
+void display_get_stats(display_stats_t *out) {
+    *out = stats;
+    out->frames_requested = atomic_load(&next_seq);
+}
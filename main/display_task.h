@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "ssd1306.h"
+
+#define DISPLAY_TEXT_MAX (SSD1306_FB_SIZE / SSD1306_GLYPH_WIDTH)
+
+typedef struct {
+    uint32_t frames_requested;
+    uint32_t frames_rendered;
+    uint32_t frames_coalesced;  /* overwritten in the mailbox before the task drew them */
+    uint32_t frames_skipped;    /* identical to what is already on the panel */
+    uint32_t max_render_us;
+} display_stats_t;
+
+/*
+ * Starts the low-priority render task. oled only needs ssd1306_setup(); the
+ * task runs ssd1306_init() itself and owns oled (and the I2C bus) from here on.
+ */
+esp_err_t display_task_start(ssd1306_t *oled);
+
+/*
+ * Replaces the screen with text starting at page. Only waits for a concurrent
+ * caller, never for the panel; only the latest request is drawn. Does
+ * nothing if the display task did not start.
+ */
+void display_show_text(uint8_t page, const char *text, size_t len);
+
+void display_get_stats(display_stats_t *stats);
@@ -0,0 +1,48 @@
+#include "track_library.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "track_catalog.h"
+#include "boot.h"
+
+#define TRACK_LIBRARY_STACK 4096
+#define TRACK_LIBRARY_PRIORITY (tskIDLE_PRIORITY + 1)
+
+static const char *TAG = "LIBRARY";
+
+static void track_library_task(void *pvParameters) {
+    track_catalog_scan_stats_t stats;
+    int64_t start = esp_timer_get_time();
+    esp_err_t err = track_catalog_rescan(CONFIG_TRACK_CATALOG_PATH, CONFIG_MUSIC_DIR, &stats);
+    int64_t elapsed_ms = (esp_timer_get_time() - start) / 1000;
+    boot_mark(BOOT_STAGE_CATALOG);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Rescan of %s failed: %s", CONFIG_MUSIC_DIR, esp_err_to_name(err));
+    } else {
+        ESP_LOGI(TAG, "%lu tracks in %lld ms: %lu unchanged, %lu parsed, %lu removed", stats.tracks, elapsed_ms,
+                 stats.unchanged, stats.parsed, stats.removed);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t track_library_start(void) {
+    esp_vfs_spiffs_conf_t conf = {
+        .base_path = "/spiffs",
+        .partition_label = "storage",
+        .max_files = 4,
+        .format_if_mount_failed = false,
+    };
+    esp_err_t err = esp_vfs_spiffs_register(&conf);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to mount SPIFFS: %s", esp_err_to_name(err));
+        return err;
+    }
+    if (xTaskCreate(track_library_task, "track_library", TRACK_LIBRARY_STACK, NULL, TRACK_LIBRARY_PRIORITY,
+                    NULL) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "esp_err.h"
+
+/*
+ * Mounts the storage partition and refreshes the track catalog from a
+ * low-priority task, so boot does not wait on the file system.
+ */
+esp_err_t track_library_start(void);
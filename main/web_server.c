@@ -0,0 +1,88 @@
+#include "web_server.h"
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "metrics.h"
+#include "metrics_http.h"
+#include "stream_relay.h"
+
+/* Below the audio pipeline: a scrape must never delay decoding or I2S. */
+#define WEB_SERVER_PRIORITY (tskIDLE_PRIORITY + 2)
+
+static const char *TAG = "WEB";
+
+static httpd_handle_t server;
+static stream_relay_handle_t relay;
+
+static int64_t relay_listeners(void *ctx) {
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(relay, &stats);
+    return stats.clients;
+}
+
+static int64_t relay_skips(void *ctx) {
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(relay, &stats);
+    return stats.skips;
+}
+
+static int64_t relay_dropped(void *ctx) {
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(relay, &stats);
+    return stats.dropped;
+}
+
+static int64_t relay_bytes_out(void *ctx) {
+    stream_relay_stats_t stats;
+    stream_relay_get_stats(relay, &stats);
+    return (int64_t)stats.bytes_out;
+}
+
+static esp_err_t relay_start(void) {
+    stream_relay_config_t config = STREAM_RELAY_DEFAULT_CONFIG();
+    config.buffer_size = CONFIG_RELAY_BUFFER_SIZE;
+    config.max_clients = CONFIG_RELAY_MAX_CLIENTS;
+    esp_err_t err = stream_relay_start(server, &config, &relay);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start stream relay: %s", esp_err_to_name(err));
+        return err;
+    }
+    metrics_gauge_register("relay_listeners", relay_listeners, NULL);
+    metrics_gauge_register("relay_skips", relay_skips, NULL);
+    metrics_gauge_register("relay_dropped", relay_dropped, NULL);
+    metrics_gauge_register("relay_bytes_out", relay_bytes_out, NULL);
+    ESP_LOGI(TAG, "Relaying the stream to %d listener(s) at http://<device>%s", CONFIG_RELAY_MAX_CLIENTS,
+             STREAM_RELAY_URI);
+    return ESP_OK;
+}
+
+esp_err_t web_server_start(void) {
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.task_priority = WEB_SERVER_PRIORITY;
+    esp_err_t err = httpd_start(&server, &config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(err));
+        return err;
+    }
+    err = metrics_http_register(server);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Metrics at http://<device>%s", METRICS_HTTP_URI);
+    } else if (err != ESP_ERR_NOT_SUPPORTED) {
+        return err;
+    }
+    return CONFIG_RELAY_MAX_CLIENTS > 0 ? relay_start() : ESP_OK;
+}
+
+void web_server_relay(const void *data, size_t len) {
+    if (relay != NULL) {
+        stream_relay_write(relay, data, len);
+    }
+}
+
+void web_server_relay_finish(void) {
+    if (relay != NULL) {
+        stream_relay_finish(relay);
+    }
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stddef.h>
+#include "esp_err.h"
+
+/* Starts the HTTP server on port 80 with the /metrics and /stream.mp3 endpoints. */
+esp_err_t web_server_start(void);
+
+/*
+ * Passes upstream MP3 bytes on to /stream.mp3 listeners. Never blocks;
+ * does nothing until the server is up.
+ */
+void web_server_relay(const void *data, size_t len);
+
+/* The upstream has ended: listeners get the rest of the stream, then are closed. */
+void web_server_relay_finish(void);
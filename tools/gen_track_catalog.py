@@ -0,0 +1,315 @@
+#!/usr/bin/env python3
+"""Build a track catalog on the host, in the format of components/track_catalog.
+
+Copy the MP3 files and the catalog to the SD card or SPIFFS image together:
+
+    tools/gen_track_catalog.py music/ tracks.cat --prefix /spiffs
+
+Paths are stored with music_dir replaced by the prefix, as the device sees
+them. Each record keeps the host size and mtime; files that are copied with
+a different mtime are parsed again by the first rescan on the device.
+"""
+
+import argparse
+import os
+import stat
+import struct
+import sys
+from typing import BinaryIO, List, NamedTuple, Optional, Tuple
+
+# Must match track_catalog.h / track_catalog.c / track_probe.h
+PATH_MAX = 256
+TEXT_MAX = 128
+MAX_DEPTH = 4
+PROBE_BYTES = 4096
+CATALOG_MAGIC = 0x54414354
+CATALOG_VERSION = 2
+HEADER = struct.Struct('<IHHIII12x')
+RECORD = struct.Struct('<IIIIIIHBBB3x')
+
+BITRATES_V1 = (0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320)
+BITRATES_V2 = (0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160)
+SAMPLE_RATES = {1: (44100, 48000, 32000), 2: (22050, 24000, 16000), 25: (11025, 12000, 8000)}
+
+
+class Frame(NamedTuple):
+    version: int
+    channels: int
+    sample_rate: int
+    bitrate_kbps: int
+    samples: int
+    side_info_bytes: int
+    frame_bytes: int
+
+
+class Track(NamedTuple):
+    path: bytes
+    title: bytes
+    artist: bytes
+    size: int
+    mtime: int
+    duration_ms: int
+    audio_offset: int
+    bitrate_kbps: int
+
+
+def parse_frame(h: bytes) -> Optional[Frame]:
+    if len(h) < 4 or h[0] != 0xFF or (h[1] & 0xE0) != 0xE0:
+        return None
+    version_bits = (h[1] >> 3) & 3
+    layer_bits = (h[1] >> 1) & 3
+    bitrate_index = h[2] >> 4
+    rate_index = (h[2] >> 2) & 3
+    if version_bits == 1 or layer_bits != 1 or bitrate_index in (0, 15) or rate_index == 3:
+        return None
+    version = {3: 1, 2: 2, 0: 25}[version_bits]
+    mono = (h[3] >> 6) == 3
+    padding = (h[2] >> 1) & 1
+    rate = SAMPLE_RATES[version][rate_index]
+    if version == 1:
+        bitrate = BITRATES_V1[bitrate_index]
+        return Frame(version, 1 if mono else 2, rate, bitrate, 1152, 17 if mono else 32,
+                     144000 * bitrate // rate + padding)
+    bitrate = BITRATES_V2[bitrate_index]
+    return Frame(version, 1 if mono else 2, rate, bitrate, 576, 9 if mono else 17, 72000 * bitrate // rate + padding)
+
+
+def compatible(a: Frame, b: Frame) -> bool:
+    return a.version == b.version and a.sample_rate == b.sample_rate and a.channels == b.channels
+
+
+def id3v2_size(buf: bytes) -> int:
+    if len(buf) < 10 or buf[:3] != b'ID3' or (buf[6] | buf[7] | buf[8] | buf[9]) & 0x80:
+        return 0
+    size = (buf[6] << 21) | (buf[7] << 14) | (buf[8] << 7) | buf[9]
+    footer = buf[3] == 4 and buf[5] & 0x10
+    return 10 + size + (10 if footer else 0)
+
+
+def vbr_frame_count(frame: bytes, header: Frame) -> Optional[int]:
+    xing = 4 + header.side_info_bytes
+    if len(frame) >= xing + 12 and frame[xing:xing + 4] in (b'Xing', b'Info'):
+        flags, frames = struct.unpack_from('>II', frame, xing + 4)
+        return frames if flags & 1 else None
+    vbri = 4 + 32
+    if len(frame) >= vbri + 18 and frame[vbri:vbri + 4] == b'VBRI':
+        return int(struct.unpack_from('>I', frame, vbri + 14)[0])
+    return None
+
+
+def syncsafe(b: bytes) -> int:
+    return ((b[0] & 0x7F) << 21) | ((b[1] & 0x7F) << 14) | ((b[2] & 0x7F) << 7) | (b[3] & 0x7F)
+
+
+def put_utf8(out: bytearray, cp: int) -> bool:
+    """Appends one code point unless it would not fit with the device's terminator."""
+    if cp < 0x80:
+        enc = bytes([cp])
+    elif cp < 0x800:
+        enc = bytes([0xC0 | (cp >> 6), 0x80 | (cp & 0x3F)])
+    elif cp < 0x10000:
+        enc = bytes([0xE0 | (cp >> 12), 0x80 | ((cp >> 6) & 0x3F), 0x80 | (cp & 0x3F)])
+    else:
+        enc = bytes([0xF0 | (cp >> 18), 0x80 | ((cp >> 12) & 0x3F), 0x80 | ((cp >> 6) & 0x3F), 0x80 | (cp & 0x3F)])
+    if len(out) + len(enc) >= TEXT_MAX:
+        return False
+    out += enc
+    return True
+
+
+def id3_text(data: bytes) -> bytes:
+    out = bytearray()
+    if data:
+        encoding = data[0]
+        p, end = 1, len(data)
+        if encoding in (1, 2):
+            big_endian = encoding == 2
+            if encoding == 1 and end - p >= 2:
+                big_endian = data[p:p + 2] == b'\xfe\xff'
+                if data[p:p + 2] in (b'\xfe\xff', b'\xff\xfe'):
+                    p += 2
+            order = 'big' if big_endian else 'little'
+            while end - p >= 2:
+                cp = int.from_bytes(data[p:p + 2], order)
+                p += 2
+                if cp == 0:
+                    break
+                if 0xD800 <= cp < 0xDC00 and end - p >= 2:
+                    low = int.from_bytes(data[p:p + 2], order)
+                    if 0xDC00 <= low < 0xE000:
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00)
+                        p += 2
+                if 0xD800 <= cp < 0xE000:
+                    cp = ord('?')
+                if not put_utf8(out, cp):
+                    break
+        else:
+            while p < end and data[p] != 0:
+                if encoding == 3:
+                    c = data[p]
+                    seq = 1 if c < 0x80 else 4 if c >= 0xF0 else 3 if c >= 0xE0 else 2
+                    if seq > end - p or len(out) + seq >= TEXT_MAX:
+                        break
+                    out += data[p:p + seq]
+                    p += seq
+                else:
+                    if not put_utf8(out, data[p]):
+                        break
+                    p += 1
+    return bytes(out).rstrip(b' ')
+
+
+def parse_id3(tag: bytes) -> Tuple[bytes, bytes]:
+    title = artist = b''
+    version = tag[3]
+    if version < 2 or version > 4:
+        return title, artist
+    header = 6 if version == 2 else 10
+    pos = 10
+    if version >= 3 and tag[5] & 0x40 and len(tag) >= 14:
+        pos += struct.unpack_from('>I', tag, 10)[0] + 4 if version == 3 else syncsafe(tag[10:14])
+    while pos + header <= len(tag):
+        frame = tag[pos:pos + header]
+        if frame[0] == 0:
+            break
+        if version == 2:
+            size = (frame[3] << 16) | (frame[4] << 8) | frame[5]
+        elif version == 3:
+            size = struct.unpack_from('>I', frame, 4)[0]
+        else:
+            size = syncsafe(frame[4:8])
+        if size > len(tag) - pos - header:
+            break
+        body = tag[pos + header:pos + header + size]
+        frame_id = frame[:3] if version == 2 else frame[:4]
+        if frame_id in (b'TT2', b'TIT2'):
+            title = id3_text(body)
+        elif frame_id in (b'TP1', b'TPE1'):
+            artist = id3_text(body)
+        pos += header + size
+    return title, artist
+
+
+def title_from_path(path: bytes) -> bytes:
+    name = path.rsplit(b'/', 1)[-1]
+    dot = name.rfind(b'.')
+    if dot > 0:
+        name = name[:dot]
+    if len(name) >= TEXT_MAX:
+        n = TEXT_MAX - 1
+        while n > 0 and (name[n] & 0xC0) == 0x80:
+            n -= 1
+        name = name[:n]
+    return name
+
+
+def probe(host_path: str, device_path: bytes, size: int) -> Optional[Track]:
+    with open(host_path, 'rb') as f:
+        buf = f.read(PROBE_BYTES)
+        title = artist = b''
+        tag_size = id3v2_size(buf)
+        if tag_size:
+            title, artist = parse_id3(buf[:tag_size])
+            f.seek(tag_size)
+            buf = f.read(PROBE_BYTES)
+
+    found = None
+    for pos in range(len(buf) - 3):
+        header = parse_frame(buf[pos:pos + 4])
+        if header is None:
+            continue
+        after = pos + header.frame_bytes
+        if after + 4 > len(buf):
+            found = pos, header
+            break
+        following = parse_frame(buf[after:after + 4])
+        if following and compatible(header, following):
+            found = pos, header
+            break
+    if not found:
+        return None
+    pos, header = found
+
+    audio_offset = (tag_size + pos) & 0xFFFFFFFF
+    audio_bytes = size - audio_offset if size > audio_offset else 0
+    frames = vbr_frame_count(buf[pos:], header)
+    if frames:
+        duration = frames * header.samples * 1000 // header.sample_rate & 0xFFFFFFFF
+        bitrate = audio_bytes * 8 // duration if duration else header.bitrate_kbps
+    else:
+        bitrate = header.bitrate_kbps
+        duration = audio_bytes * 8 // header.bitrate_kbps & 0xFFFFFFFF
+    return Track(device_path, title or title_from_path(device_path), artist, size, 0, duration, audio_offset,
+                 bitrate & 0xFFFF)
+
+
+def walk_order(name: bytes) -> bytes:
+    # Same order as walk_order() on the device: '/' sorts before any other byte.
+    return name.replace(b'/', b'\x01')
+
+
+def walk(host_dir: str, device_dir: bytes, depth: int, tracks: List[Track]) -> None:
+    # Sorted like the device walk, so a rescan merges the records in one pass.
+    with os.scandir(host_dir) as it:
+        entries = sorted(it, key=lambda e: walk_order(os.fsencode(e.name)))
+        for entry in entries:
+            name = os.fsencode(entry.name)
+            if name.startswith(b'.') or len(device_dir) + 1 + len(name) >= PATH_MAX:
+                continue
+            device_path = device_dir + b'/' + name
+            try:
+                st = os.stat(entry.path)
+            except OSError:
+                continue
+            if stat.S_ISDIR(st.st_mode):
+                if depth < MAX_DEPTH:
+                    walk(entry.path, device_path, depth + 1, tracks)
+            elif len(name) > 4 and name[-4:].lower() == b'.mp3':
+                size = st.st_size & 0xFFFFFFFF
+                track = probe(entry.path, device_path, size)
+                if track is None:
+                    print(f'Skipping {entry.path}: no MPEG audio found', file=sys.stderr)
+                    continue
+                tracks.append(track._replace(mtime=st.st_mtime_ns // 1000000000 & 0xFFFFFFFF))
+
+
+def path_hash(path: bytes) -> int:
+    h = 2166136261
+    for c in path:
+        h = ((h ^ c) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def write_catalog(out: BinaryIO, tracks: List[Track]) -> None:
+    records = bytearray()
+    strings = bytearray()
+    for t in tracks:
+        records += RECORD.pack(path_hash(t.path), t.size, t.mtime, t.duration_ms, t.audio_offset, len(strings),
+                               t.bitrate_kbps, len(t.path), len(t.title), len(t.artist))
+        strings += t.path + t.title + t.artist
+    out.write(HEADER.pack(CATALOG_MAGIC, CATALOG_VERSION, RECORD.size, len(tracks), HEADER.size + len(records),
+                          len(strings)))
+    out.write(records)
+    out.write(strings)
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('music_dir')
+    parser.add_argument('output')
+    parser.add_argument('--prefix', help='device path of music_dir (default: music_dir as given)')
+    args = parser.parse_args()
+
+    music_dir = args.music_dir.rstrip('/') or '/'
+    prefix = os.fsencode(args.prefix if args.prefix is not None else music_dir)
+    if len(prefix) >= PATH_MAX:
+        parser.error('prefix too long')
+    tracks: List[Track] = []
+    walk(music_dir, prefix, 0, tracks)
+    with open(args.output, 'wb') as out:
+        write_catalog(out, tracks)
+    print(f'{args.output}: {len(tracks)} tracks')
+
+
+if __name__ == '__main__':
+    main()